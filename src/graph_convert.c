@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "os_graph.h"
+#include "os_graph_bin.h"
+#include "os_graph_order.h"
+#include "log/log.h"
+#include "utils.h"
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-t] [-c] [-o none|degree|bfs|rcm] input_file output_file\n", argv0);
+	fprintf(stderr, "  -t  write the text format (default: binary)\n");
+	fprintf(stderr, "  -c  verify the data checksum of a binary input file\n");
+	fprintf(stderr, "  -o  relabel the nodes for locality, keeping their input IDs in binary output\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	os_graph_order_t order = GRAPH_ORDER_NONE;
+	FILE *input_file, *output_file;
+	os_graph_t *graph;
+	int to_text = 0;
+	int verify = 0;
+	int opt, rc;
+
+	while ((opt = getopt(argc, argv, "tco:")) != -1) {
+		switch (opt) {
+		case 't':
+			to_text = 1;
+			break;
+		case 'c':
+			verify = 1;
+			break;
+		case 'o':
+			if (parse_graph_order(optarg, &order) < 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (argc - optind != 2)
+		usage(argv[0]);
+
+	input_file = fopen(argv[optind], "r");
+	DIE(input_file == NULL, "fopen");
+
+	if (graph_file_is_binary(input_file))
+		graph = create_graph_from_binary(input_file, verify);
+	else
+		graph = create_graph_from_file(input_file);
+	if (graph == NULL) {
+		log_fatal("Can't load graph from %s", argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (order != GRAPH_ORDER_NONE) {
+		os_graph_t *reordered = reorder_graph(graph, order);
+
+		destroy_graph(graph);
+		graph = reordered;
+	}
+
+	output_file = fopen(argv[optind + 1], "w");
+	DIE(output_file == NULL, "fopen");
+
+	if (to_text)
+		rc = write_graph_text(graph, output_file);
+	else
+		rc = write_graph_binary(graph, output_file);
+	DIE(rc < 0, "write");
+
+	rc = fclose(output_file);
+	DIE(rc < 0, "fclose");
+
+	destroy_graph(graph);
+	fclose(input_file);
+
+	return 0;
+}
@@ -0,0 +1,432 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Synthetic graph generator.
+ *
+ * Every edge and node value is a function of the seed and of its index
+ * alone, so graphs are reproducible and generated as they are written,
+ * in constant memory for the text format. The binary format needs the
+ * edges grouped by node, so they are generated twice, to count degrees
+ * and then to fill in the neighbours, straight into the mapped file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "os_graph.h"
+#include "os_graph_bin.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* Default R-MAT quadrant probabilities, as in the Graph500 benchmark. */
+#define RMAT_A		0.57
+#define RMAT_B		0.19
+#define RMAT_C		0.19
+
+/* Independent random streams derived from the seed. */
+#define STREAM_VALUES	1
+#define STREAM_EDGES	2
+#define STREAM_LABELS	3
+#define STREAM_WEIGHTS	4
+
+typedef enum {
+	GEN_RMAT,
+	GEN_GRID,
+	GEN_CHAIN,
+	GEN_STAR
+} gen_type_t;
+
+typedef struct {
+	gen_type_t type;
+	unsigned int num_nodes;
+	unsigned int num_edges;
+	uint64_t seed;
+	int min_value, max_value;
+	unsigned int max_weight; // Edge weights in [1, max_weight], 0 for an unweighted graph
+
+	unsigned int scale; // R-MAT: 2^scale nodes
+	double a, b, c; // R-MAT: probabilities of the top left, top right, bottom left quadrants
+	uint64_t mul1, mul2; // R-MAT: odd multipliers of the node relabeling
+
+	unsigned int cols; // Grid: nodes per row
+} gen_t;
+
+static inline uint64_t splitmix64(uint64_t *state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+	return z ^ (z >> 31);
+}
+
+/* Start of the random sequence of item 'idx' of a stream. */
+static inline uint64_t stream_state(const gen_t *g, uint64_t stream, uint64_t idx)
+{
+	uint64_t state = g->seed ^ (stream << 56);
+
+	state = splitmix64(&state) + idx;
+	splitmix64(&state);
+
+	return state;
+}
+
+static inline double random_unit(uint64_t *state)
+{
+	return (splitmix64(state) >> 11) * 0x1.0p-53;
+}
+
+static int node_value(const gen_t *g, unsigned int idx)
+{
+	uint64_t state = stream_state(g, STREAM_VALUES, idx);
+	uint64_t range = (uint64_t) ((long long) g->max_value - g->min_value) + 1;
+
+	return (long long) g->min_value + (long long) (splitmix64(&state) % range);
+}
+
+static unsigned int edge_weight(const gen_t *g, unsigned long idx)
+{
+	uint64_t state = stream_state(g, STREAM_WEIGHTS, idx);
+
+	return 1 + splitmix64(&state) % g->max_weight;
+}
+
+/*
+ * Shuffle the R-MAT node labels, so that node ids tell nothing about the
+ * degree: a bijection of [0, 2^scale) made of odd multiplications and
+ * xor-shifts, modulo 2^scale.
+ */
+static unsigned int rmat_relabel(const gen_t *g, uint64_t v)
+{
+	uint64_t mask = (1ULL << g->scale) - 1;
+
+	v = (v * g->mul1) & mask;
+	v ^= v >> (g->scale / 2 + 1);
+	v = (v * g->mul2) & mask;
+
+	return v;
+}
+
+/* Edge 'idx' of an R-MAT graph: pick a quadrant of the adjacency matrix per level. */
+static void rmat_edge(const gen_t *g, unsigned long idx, unsigned int *src, unsigned int *dst)
+{
+	uint64_t state = stream_state(g, STREAM_EDGES, idx);
+	uint64_t u = 0, v = 0;
+
+	for (unsigned int level = 0; level < g->scale; level++) {
+		double r = random_unit(&state);
+
+		u <<= 1;
+		v <<= 1;
+		if (r < g->a)
+			continue;
+		if (r < g->a + g->b) {
+			v |= 1;
+		} else if (r < g->a + g->b + g->c) {
+			u |= 1;
+		} else {
+			u |= 1;
+			v |= 1;
+		}
+	}
+
+	*src = rmat_relabel(g, u);
+	*dst = rmat_relabel(g, v);
+}
+
+/* Edge 'idx' of a grid: the horizontal edges, row by row, then the vertical ones. */
+static void grid_edge(const gen_t *g, unsigned long idx, unsigned int *src, unsigned int *dst)
+{
+	unsigned long rows = g->num_nodes / g->cols;
+	unsigned long horizontal = rows * (g->cols - 1);
+
+	if (idx < horizontal) {
+		*src = idx / (g->cols - 1) * g->cols + idx % (g->cols - 1);
+		*dst = *src + 1;
+	} else {
+		*src = idx - horizontal;
+		*dst = *src + g->cols;
+	}
+}
+
+static void gen_edge(const gen_t *g, unsigned long idx, unsigned int *src, unsigned int *dst)
+{
+	switch (g->type) {
+	case GEN_RMAT:
+		rmat_edge(g, idx, src, dst);
+		break;
+	case GEN_GRID:
+		grid_edge(g, idx, src, dst);
+		break;
+	case GEN_CHAIN:
+		*src = idx;
+		*dst = idx + 1;
+		break;
+	case GEN_STAR:
+		*src = 0;
+		*dst = idx + 1;
+		break;
+	}
+}
+
+/* Buffered output of numbers, much faster than fprintf() per number. */
+typedef struct {
+	FILE *file;
+	size_t len;
+	char buf[1 << 16];
+} text_writer_t;
+
+static void writer_flush(text_writer_t *w)
+{
+	DIE(fwrite(w->buf, 1, w->len, w->file) != w->len, "fwrite");
+	w->len = 0;
+}
+
+static void write_number(text_writer_t *w, long long val, char sep)
+{
+	char digits[24];
+	unsigned long long n = val < 0 ? -(unsigned long long) val : (unsigned long long) val;
+	int len = 0;
+
+	if (sizeof(w->buf) - w->len < sizeof(digits))
+		writer_flush(w);
+
+	do {
+		digits[len++] = '0' + n % 10;
+		n /= 10;
+	} while (n != 0);
+	if (val < 0)
+		w->buf[w->len++] = '-';
+	while (len > 0)
+		w->buf[w->len++] = digits[--len];
+	w->buf[w->len++] = sep;
+}
+
+static void write_text(const gen_t *g, FILE *file)
+{
+	text_writer_t *w = malloc(sizeof(*w));
+
+	DIE(w == NULL, "malloc");
+	w->file = file;
+	w->len = 0;
+
+	write_number(w, g->num_nodes, ' ');
+	write_number(w, g->num_edges, '\n');
+	for (unsigned int i = 0; i < g->num_nodes; i++)
+		write_number(w, node_value(g, i), i + 1 < g->num_nodes ? ' ' : '\n');
+
+	for (unsigned long i = 0; i < g->num_edges; i++) {
+		unsigned int src, dst;
+
+		gen_edge(g, i, &src, &dst);
+		write_number(w, src, ' ');
+		if (g->max_weight == 0) {
+			write_number(w, dst, '\n');
+		} else {
+			write_number(w, dst, ' ');
+			write_number(w, edge_weight(g, i), '\n');
+		}
+	}
+
+	writer_flush(w);
+	free(w);
+}
+
+/* Fill in the mapped CSR sections, like create_graph_from_data() does. */
+static void write_binary(const gen_t *g, FILE *file)
+{
+	os_graph_t *graph = map_graph_binary_output(file, g->num_nodes, g->num_edges,
+			g->max_weight != 0);
+	unsigned long *offsets = graph->offsets;
+	unsigned int src, dst;
+	int rc;
+
+	for (unsigned int i = 0; i < g->num_nodes; i++)
+		graph->values[i] = node_value(g, i);
+
+	/* The sections are zeroed: count degrees into 'offsets[idx + 1]'. */
+	for (unsigned long i = 0; i < g->num_edges; i++) {
+		gen_edge(g, i, &src, &dst);
+		offsets[src + 1]++;
+		offsets[dst + 1]++;
+	}
+	for (unsigned int i = 0; i < g->num_nodes; i++)
+		offsets[i + 1] += offsets[i];
+
+	/* Generate the edges again, scattering them with 'offsets' as cursors. */
+	for (unsigned long i = 0; i < g->num_edges; i++) {
+		unsigned long psrc, pdst;
+
+		gen_edge(g, i, &src, &dst);
+		psrc = offsets[src]++;
+		pdst = offsets[dst]++;
+		graph->neighbours[psrc] = dst;
+		graph->neighbours[pdst] = src;
+		if (graph->weights != NULL)
+			graph->weights[psrc] = graph->weights[pdst] = edge_weight(g, i);
+	}
+	for (unsigned int i = g->num_nodes; i > 0; i--)
+		offsets[i] = offsets[i - 1];
+	offsets[0] = 0;
+
+	rc = finish_graph_binary_output(graph);
+	DIE(rc < 0, "msync");
+	destroy_graph(graph);
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-b] [-s seed] [-v min:max] [-w max] [-p a,b,c] type params... output_file\n",
+			argv0);
+	fprintf(stderr, "Types:\n");
+	fprintf(stderr, "  rmat SCALE EDGE_FACTOR  R-MAT graph of 2^SCALE nodes and EDGE_FACTOR edges per node\n");
+	fprintf(stderr, "  grid ROWS COLS          2D grid, each node linked to its right and lower neighbours\n");
+	fprintf(stderr, "  chain NODES             path through all the nodes\n");
+	fprintf(stderr, "  star NODES              node 0 linked to all the others\n");
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -b  write the binary format (default: text; '-' writes text to stdout)\n");
+	fprintf(stderr, "  -s  random seed (default: 1)\n");
+	fprintf(stderr, "  -v  range of the node values (default: -1000:1000)\n");
+	fprintf(stderr, "  -w  weigh the edges, uniformly in [1, max] (default: unweighted)\n");
+	fprintf(stderr, "  -p  R-MAT quadrant probabilities (default: %g,%g,%g)\n", RMAT_A, RMAT_B, RMAT_C);
+	exit(EXIT_FAILURE);
+}
+
+/* Parse a number in [min, max]. Exit with the usage message otherwise. */
+static unsigned long long parse_number(const char *argv0, const char *str,
+		unsigned long long min, unsigned long long max)
+{
+	unsigned long long val;
+	char *end;
+
+	val = strtoull(str, &end, 0);
+	if (*str == '\0' || *str == '-' || *end != '\0' || val < min || val > max)
+		usage(argv0);
+
+	return val;
+}
+
+/* Set the sizes of 'g' from the parameters of its type. */
+static void gen_setup(gen_t *g, const char *argv0, char **params, int num_params)
+{
+	unsigned long long nodes, edges;
+
+	if (g->type == GEN_RMAT) {
+		if (num_params != 2)
+			usage(argv0);
+		g->scale = parse_number(argv0, params[0], 1, 31);
+		nodes = 1ULL << g->scale;
+		edges = nodes * parse_number(argv0, params[1], 1, UINT_MAX);
+	} else if (g->type == GEN_GRID) {
+		unsigned long long rows, cols;
+
+		if (num_params != 2)
+			usage(argv0);
+		rows = parse_number(argv0, params[0], 1, UINT_MAX);
+		cols = parse_number(argv0, params[1], 1, UINT_MAX);
+		nodes = rows * cols;
+		edges = rows * (cols - 1) + (rows - 1) * cols;
+		g->cols = cols;
+	} else {
+		if (num_params != 1)
+			usage(argv0);
+		nodes = parse_number(argv0, params[0], 1, UINT_MAX);
+		edges = nodes - 1;
+	}
+
+	/* Node ids and edge counts are 32-bit wide in the graph formats. */
+	if (nodes > UINT_MAX || edges > UINT_MAX) {
+		log_fatal("Graph too large: %llu nodes, %llu edges", nodes, edges);
+		exit(EXIT_FAILURE);
+	}
+	g->num_nodes = nodes;
+	g->num_edges = edges;
+}
+
+int main(int argc, char *argv[])
+{
+	gen_t g = {
+		.seed = 1, .min_value = -1000, .max_value = 1000,
+		.a = RMAT_A, .b = RMAT_B, .c = RMAT_C,
+	};
+	const char *output;
+	uint64_t state;
+	FILE *file;
+	int binary = 0;
+	int opt, rc;
+
+	while ((opt = getopt(argc, argv, "bs:v:w:p:")) != -1) {
+		switch (opt) {
+		case 'b':
+			binary = 1;
+			break;
+		case 's':
+			g.seed = parse_number(argv[0], optarg, 0, ULLONG_MAX);
+			break;
+		case 'v':
+			if (sscanf(optarg, "%d:%d", &g.min_value, &g.max_value) != 2 ||
+			    g.min_value > g.max_value)
+				usage(argv[0]);
+			break;
+		case 'w':
+			g.max_weight = parse_number(argv[0], optarg, 1, UINT_MAX);
+			break;
+		case 'p':
+			if (sscanf(optarg, "%lf,%lf,%lf", &g.a, &g.b, &g.c) != 3 ||
+			    g.a < 0 || g.b < 0 || g.c < 0 || g.a + g.b + g.c > 1)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (argc - optind < 3)
+		usage(argv[0]);
+
+	if (strcmp(argv[optind], "rmat") == 0)
+		g.type = GEN_RMAT;
+	else if (strcmp(argv[optind], "grid") == 0)
+		g.type = GEN_GRID;
+	else if (strcmp(argv[optind], "chain") == 0)
+		g.type = GEN_CHAIN;
+	else if (strcmp(argv[optind], "star") == 0)
+		g.type = GEN_STAR;
+	else
+		usage(argv[0]);
+
+	gen_setup(&g, argv[0], argv + optind + 1, argc - optind - 2);
+	output = argv[argc - 1];
+
+	state = stream_state(&g, STREAM_LABELS, 0);
+	g.mul1 = splitmix64(&state) | 1;
+	g.mul2 = splitmix64(&state) | 1;
+
+	if (strcmp(output, "-") == 0) {
+		if (binary)
+			usage(argv[0]);
+		write_text(&g, stdout);
+		rc = fflush(stdout);
+		DIE(rc != 0, "fflush");
+		return 0;
+	}
+
+	/* Read and write access, as the binary format is written through a mapping. */
+	file = fopen(output, binary ? "w+" : "w");
+	DIE(file == NULL, "fopen");
+
+	if (binary)
+		write_binary(&g, file);
+	else
+		write_text(&g, file);
+
+	rc = fclose(file);
+	DIE(rc != 0, "fclose");
+
+	return 0;
+}
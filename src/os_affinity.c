@@ -0,0 +1,204 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "os_affinity.h"
+
+#define NODE_PATH		"/sys/devices/system/node"
+
+/* Highest number of NUMA nodes handled; CPUs of further nodes are pooled. */
+#define MAX_NODES		64
+
+#define BITS_PER_LONG		(8 * sizeof(unsigned long))
+
+static struct {
+	pthread_once_t once;
+
+	/* CPUs the process may run on, the ones of a node next to each other. */
+	unsigned int num_cpus;
+	int cpus[CPU_SETSIZE];
+
+	/* Nodes with at least one of these CPUs, and their CPUs. */
+	unsigned int num_nodes;
+	cpu_set_t node_cpus[MAX_NODES + 1];
+
+	/* Nodes with memory, to interleave pages on. */
+	unsigned int num_mem_nodes;
+	unsigned long mem_nodes[MAX_NODES / BITS_PER_LONG];
+} topo = { .once = PTHREAD_ONCE_INIT };
+
+/*
+ * Read a list such as "0-3,8,10-11" from 'path' into the 'max' bit
+ * 'bitmap'. Numbers past 'max' are dropped. Return -1 if it can't be read.
+ */
+static int read_list(const char *path, unsigned long *bitmap, unsigned int max)
+{
+	char buf[4096];
+	char *pos, *end;
+	size_t len;
+	FILE *file;
+
+	file = fopen(path, "r");
+	if (file == NULL)
+		return -1;
+	len = fread(buf, 1, sizeof(buf) - 1, file);
+	fclose(file);
+	buf[len] = '\0';
+
+	memset(bitmap, 0, (max + BITS_PER_LONG - 1) / BITS_PER_LONG * sizeof(*bitmap));
+
+	for (pos = buf; *pos != '\0' && *pos != '\n'; pos = end) {
+		unsigned long first, last;
+
+		first = strtoul(pos, &end, 10);
+		if (end == pos)
+			return -1;
+		last = first;
+		if (*end == '-') {
+			pos = end + 1;
+			last = strtoul(pos, &end, 10);
+			if (end == pos)
+				return -1;
+		}
+		if (*end == ',')
+			end++;
+
+		for (unsigned long i = first; i <= last && i < max; i++)
+			bitmap[i / BITS_PER_LONG] |= 1UL << (i % BITS_PER_LONG);
+	}
+
+	return 0;
+}
+
+static inline int bitmap_test(const unsigned long *bitmap, unsigned int i)
+{
+	return (bitmap[i / BITS_PER_LONG] >> (i % BITS_PER_LONG)) & 1;
+}
+
+/* Make the CPUs of 'set' not listed yet a new node, if there are any. */
+static void add_node(const cpu_set_t *set, cpu_set_t *listed)
+{
+	cpu_set_t *node = &topo.node_cpus[topo.num_nodes];
+
+	CPU_ZERO(node);
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, set) || CPU_ISSET(cpu, listed))
+			continue;
+
+		CPU_SET(cpu, node);
+		CPU_SET(cpu, listed);
+		topo.cpus[topo.num_cpus++] = cpu;
+	}
+
+	if (CPU_COUNT(node) > 0)
+		topo.num_nodes++;
+}
+
+static void topology_init(void)
+{
+	unsigned long online[MAX_NODES / BITS_PER_LONG];
+	unsigned long cpus[CPU_SETSIZE / BITS_PER_LONG];
+	cpu_set_t allowed, listed;
+	char path[64];
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+		CPU_ZERO(&allowed);
+		for (long cpu = 0; cpu < n && cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, &allowed);
+	}
+	CPU_ZERO(&listed);
+
+	if (read_list(NODE_PATH "/online", online, MAX_NODES) < 0)
+		memset(online, 0, sizeof(online));
+
+	for (unsigned int n = 0; n < MAX_NODES; n++) {
+		cpu_set_t set;
+
+		if (!bitmap_test(online, n))
+			continue;
+
+		snprintf(path, sizeof(path), NODE_PATH "/node%u/cpulist", n);
+		if (read_list(path, cpus, CPU_SETSIZE) < 0)
+			continue;
+
+		CPU_ZERO(&set);
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (bitmap_test(cpus, cpu) && CPU_ISSET(cpu, &allowed))
+				CPU_SET(cpu, &set);
+		add_node(&set, &listed);
+	}
+
+	/* No NUMA information, or CPUs of nodes past MAX_NODES. */
+	add_node(&allowed, &listed);
+
+	if (read_list(NODE_PATH "/has_memory", topo.mem_nodes, MAX_NODES) < 0)
+		memcpy(topo.mem_nodes, online, sizeof(online));
+	for (unsigned int n = 0; n < MAX_NODES; n++)
+		topo.num_mem_nodes += bitmap_test(topo.mem_nodes, n);
+}
+
+/* Number of CPUs the process may run on. */
+unsigned int affinity_num_cpus(void)
+{
+	pthread_once(&topo.once, topology_init);
+
+	return topo.num_cpus;
+}
+
+/* Number of NUMA nodes with CPUs the process may run on. */
+unsigned int affinity_num_nodes(void)
+{
+	pthread_once(&topo.once, topology_init);
+
+	return topo.num_nodes;
+}
+
+/*
+ * Fill in the CPUs 'worker' should run on under the 'pin' policy.
+ * Return -1 if it should not be pinned at all.
+ */
+int affinity_worker_cpus(os_pin_policy_t pin, unsigned int worker, cpu_set_t *set)
+{
+	pthread_once(&topo.once, topology_init);
+
+	switch (pin) {
+	case OS_PIN_CORES:
+		CPU_ZERO(set);
+		CPU_SET(topo.cpus[worker % topo.num_cpus], set);
+		return 0;
+	case OS_PIN_NUMA:
+		*set = topo.node_cpus[worker % topo.num_nodes];
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Spread the pages of [addr, addr + len) round-robin over the nodes with
+ * memory, moving the ones already touched. Pages partly outside the range
+ * are included. Return -1 (with errno set) if the kernel refused.
+ */
+int affinity_interleave(void *addr, size_t len)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	unsigned long start = (unsigned long) addr & ~(page - 1);
+	unsigned long end = ((unsigned long) addr + len + page - 1) & ~(page - 1);
+
+	pthread_once(&topo.once, topology_init);
+
+	if (topo.num_mem_nodes < 2 || len == 0)
+		return 0;
+
+	return syscall(SYS_mbind, start, end - start, MPOL_INTERLEAVE, topo.mem_nodes,
+			MAX_NODES + 1, MPOL_MF_MOVE) < 0 ? -1 : 0;
+}
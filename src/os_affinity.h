@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * CPU and NUMA placement of the threadpool workers and of the graph.
+ *
+ * The topology is read once from sched_getaffinity() and from
+ * /sys/devices/system/node, so only the CPUs the process may run on are
+ * used. Without NUMA information, all CPUs are taken as one node.
+ */
+
+#ifndef __OS_AFFINITY_H__
+#define __OS_AFFINITY_H__	1
+
+#include <stddef.h>
+#include <sched.h>
+
+typedef enum {
+	OS_PIN_NONE, // Leave the threads to the scheduler
+	OS_PIN_CORES, // One CPU per worker, filling up one node after another
+	OS_PIN_NUMA // Workers spread over the nodes, free to move within theirs
+} os_pin_policy_t;
+
+unsigned int affinity_num_cpus(void);
+unsigned int affinity_num_nodes(void);
+
+int affinity_worker_cpus(os_pin_policy_t pin, unsigned int worker, cpu_set_t *set);
+int affinity_interleave(void *addr, size_t len);
+
+#endif
@@ -0,0 +1,227 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "os_bfs.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* Frontier chunks per thread: a few, so that threads can balance load. */
+#define BFS_CHUNKS_PER_THREAD	4
+
+typedef enum {
+	BFS_TOP_DOWN,
+	BFS_BOTTOM_UP
+} bfs_direction_t;
+
+/* What a chunk discovered during one level, on its own cache line. */
+typedef struct {
+	long long sum; // Sum of the values of the discovered nodes
+	unsigned long nodes; // Number of discovered nodes
+	unsigned long edges; // Sum of the degrees of the discovered nodes
+} __attribute__((aligned(OS_CACHELINE_SIZE))) bfs_chunk_result_t;
+
+typedef struct {
+	os_graph_t *graph;
+	bfs_direction_t direction;
+
+	/* One bit per node. 'front' is the current level, 'next' the one being built. */
+	uint64_t *front;
+	uint64_t *next;
+	unsigned long num_words;
+
+	/* Chunks are ranges of bitmap words, so each word belongs to one chunk. */
+	unsigned int num_chunks;
+	unsigned long words_per_chunk;
+	bfs_chunk_result_t *results;
+} bfs_state_t;
+
+static inline int bitmap_test(const uint64_t *bitmap, unsigned int idx)
+{
+	return (bitmap[idx / 64] >> (idx % 64)) & 1;
+}
+
+/* Claim 'idx' for the current level. Return 1 if the caller got it. */
+static inline int bfs_claim(os_graph_t *graph, unsigned int idx)
+{
+	typeof(*graph->visited) expected = NOT_VISITED;
+
+	if (__atomic_load_n(&graph->visited[idx], __ATOMIC_RELAXED) != NOT_VISITED)
+		return 0;
+
+	return __atomic_compare_exchange_n(&graph->visited[idx], &expected, DONE, 0,
+			__ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/*
+ * Top-down step over the frontier words of a chunk: claim the unvisited
+ * neighbours of every frontier node. The consumed frontier words are
+ * cleared, as no other chunk reads them, so that 'front' can be reused as
+ * the 'next' bitmap of the following level.
+ */
+static void bfs_top_down(bfs_state_t *s, unsigned long w0, unsigned long w1, bfs_chunk_result_t *res)
+{
+	os_graph_t *graph = s->graph;
+
+	for (unsigned long w = w0; w < w1; w++) {
+		uint64_t word = s->front[w];
+
+		if (word == 0)
+			continue;
+		s->front[w] = 0;
+
+		while (word != 0) {
+			unsigned int v = w * 64 + __builtin_ctzll(word);
+			os_neighbour_iter_t it;
+			unsigned int u;
+
+			word &= word - 1;
+			graph_iter_init(&it, graph, v);
+			while (graph_iter_next(&it, u)) {
+				if (!bfs_claim(graph, u))
+					continue;
+
+				__atomic_fetch_or(&s->next[u / 64], 1ULL << (u % 64), __ATOMIC_RELAXED);
+				res->sum += graph->values[u];
+				res->nodes++;
+				res->edges += graph_degree(graph, u);
+			}
+		}
+	}
+}
+
+/*
+ * Bottom-up step over the nodes of a chunk: every unvisited node joins
+ * the next level if any of its neighbours is in the frontier. Nodes are
+ * only written by the chunk owning them, and the chunk's 'next' words are
+ * written whole, so nothing needs to be atomic or cleared beforehand.
+ */
+static void bfs_bottom_up(bfs_state_t *s, unsigned long w0, unsigned long w1, bfs_chunk_result_t *res)
+{
+	os_graph_t *graph = s->graph;
+
+	for (unsigned long w = w0; w < w1; w++) {
+		unsigned int first = w * 64;
+		unsigned int last = first + 64 < graph->num_nodes ? first + 64 : graph->num_nodes;
+		uint64_t word = 0;
+
+		for (unsigned int v = first; v < last; v++) {
+			os_neighbour_iter_t it;
+			unsigned int u;
+
+			if (graph->visited[v] != NOT_VISITED)
+				continue;
+
+			graph_iter_init(&it, graph, v);
+			while (graph_iter_next(&it, u)) {
+				if (!bitmap_test(s->front, u))
+					continue;
+
+				graph->visited[v] = DONE;
+				word |= 1ULL << (v % 64);
+				res->sum += graph->values[v];
+				res->nodes++;
+				res->edges += graph_degree(graph, v);
+				break;
+			}
+		}
+
+		s->next[w] = word;
+	}
+}
+
+static void bfs_chunk_function(void *arg, unsigned long first, unsigned long last)
+{
+	bfs_state_t *s = (bfs_state_t *) arg;
+
+	for (unsigned long c = first; c < last; c++) {
+		bfs_chunk_result_t *res = &s->results[c];
+		unsigned long w0 = c * s->words_per_chunk;
+		unsigned long w1 = w0 + s->words_per_chunk;
+
+		if (w1 > s->num_words)
+			w1 = s->num_words;
+
+		memset(res, 0, sizeof(*res));
+		if (s->direction == BFS_TOP_DOWN)
+			bfs_top_down(s, w0, w1, res);
+		else
+			bfs_bottom_up(s, w0, w1, res);
+	}
+}
+
+/* Expand one level on the threadpool, a task per chunk, and wait for it. */
+static void bfs_run_level(os_threadpool_t *tp, bfs_state_t *s)
+{
+	parallel_for(tp, 0, s->num_chunks, 1, bfs_chunk_function, s);
+}
+
+/*
+ * Sum up the values of the nodes reachable from 'root', visiting them
+ * level by level on the threads of 'tp'. Reached nodes are marked DONE in
+ * 'graph->visited'.
+ */
+long long bfs_sum(os_threadpool_t *tp, os_graph_t *graph, unsigned int root)
+{
+	bfs_state_t s;
+	unsigned long frontier_nodes, frontier_edges, unexplored_edges;
+	long long sum;
+
+	if (root >= graph->num_nodes || !bfs_claim(graph, root))
+		return 0;
+
+	s.graph = graph;
+	s.direction = BFS_TOP_DOWN;
+	s.num_words = (graph->num_nodes + 63) / 64;
+	s.front = calloc(s.num_words, sizeof(*s.front));
+	s.next = calloc(s.num_words, sizeof(*s.next));
+	DIE(s.front == NULL || s.next == NULL, "calloc");
+
+	s.num_chunks = tp->num_threads * BFS_CHUNKS_PER_THREAD;
+	if (s.num_chunks > s.num_words)
+		s.num_chunks = s.num_words;
+	s.words_per_chunk = (s.num_words + s.num_chunks - 1) / s.num_chunks;
+	s.results = aligned_alloc(OS_CACHELINE_SIZE, s.num_chunks * sizeof(*s.results));
+	DIE(s.results == NULL, "aligned_alloc");
+
+	s.front[root / 64] |= 1ULL << (root % 64);
+	sum = graph->values[root];
+	frontier_nodes = 1;
+	frontier_edges = graph_degree(graph, root);
+	unexplored_edges = graph->offsets[graph->num_nodes] - frontier_edges;
+
+	while (frontier_nodes > 0) {
+		uint64_t *tmp;
+
+		if (s.direction == BFS_TOP_DOWN && frontier_edges > unexplored_edges / BFS_ALPHA) {
+			s.direction = BFS_BOTTOM_UP;
+		} else if (s.direction == BFS_BOTTOM_UP && frontier_nodes < graph->num_nodes / BFS_BETA) {
+			/* Bottom-up steps leave 'next' dirty; top-down ones need it clear. */
+			memset(s.next, 0, s.num_words * sizeof(*s.next));
+			s.direction = BFS_TOP_DOWN;
+		}
+
+		bfs_run_level(tp, &s);
+
+		frontier_nodes = 0;
+		frontier_edges = 0;
+		for (unsigned int i = 0; i < s.num_chunks; i++) {
+			sum += s.results[i].sum;
+			frontier_nodes += s.results[i].nodes;
+			frontier_edges += s.results[i].edges;
+		}
+		unexplored_edges -= frontier_edges;
+
+		tmp = s.front;
+		s.front = s.next;
+		s.next = tmp;
+	}
+
+	free(s.results);
+	free(s.front);
+	free(s.next);
+
+	return sum;
+}
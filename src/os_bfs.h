@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Level-synchronous, direction-optimizing breadth-first search.
+ *
+ * The frontier is kept as a bitmap and expanded one level at a time by
+ * the threadpool. Each level is expanded either top-down (frontier nodes
+ * claim their unvisited neighbours) or bottom-up (unvisited nodes look
+ * for a neighbour in the frontier), depending on which one is expected
+ * to examine fewer edges, as described in:
+ * "Direction-Optimizing Breadth-First Search" (Beamer, Asanovic,
+ * Patterson; SC 2012).
+ */
+
+#ifndef __OS_BFS_H__
+#define __OS_BFS_H__	1
+
+#include "os_graph.h"
+#include "os_threadpool.h"
+
+/* Switch to bottom-up when the frontier has more than 1/ALPHA of the unexplored edges. */
+#define BFS_ALPHA	15
+/* Switch back to top-down when the frontier has less than 1/BETA of the nodes. */
+#define BFS_BETA	18
+
+long long bfs_sum(os_threadpool_t *tp, os_graph_t *graph, unsigned int root);
+
+#endif
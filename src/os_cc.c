@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+
+#include "os_cc.h"
+
+/* Node chunks per thread: a few, so that threads can balance load. */
+#define CC_CHUNKS_PER_THREAD	8
+
+typedef struct cc_state cc_state_t;
+
+/* A step of the algorithm, run over nodes [first, last) by each chunk. */
+typedef void (*cc_kernel_t)(cc_state_t *s, unsigned int first, unsigned int last);
+
+struct cc_state {
+	os_graph_t *graph;
+	os_components_t *cc;
+
+	unsigned int nodes_per_chunk;
+	cc_kernel_t kernel;
+
+	unsigned int round; // Neighbour linked by cc_link_round()
+	unsigned int giant; // Label of the largest component, skipped by cc_link_rest()
+};
+
+/*
+ * Labels are read and written concurrently, and only ever decrease, so
+ * relaxed atomics are enough: a stale label only costs an extra turn.
+ * Each step is a parallel_for() of its own, which orders them.
+ */
+static inline unsigned int label_load(unsigned int *label, unsigned int idx)
+{
+	return __atomic_load_n(&label[idx], __ATOMIC_RELAXED);
+}
+
+/*
+ * Merge the trees of 'u' and 'v', hanging the root with the higher id
+ * under the lower label. A label is thus never higher than its node, and
+ * the root of a tree is its smallest node.
+ */
+static void cc_link(unsigned int *label, unsigned int u, unsigned int v)
+{
+	unsigned int p1 = label_load(label, u);
+	unsigned int p2 = label_load(label, v);
+
+	while (p1 != p2) {
+		unsigned int high = p1 > p2 ? p1 : p2;
+		unsigned int low = p1 > p2 ? p2 : p1;
+		unsigned int p_high = label_load(label, high);
+
+		if (p_high == low)
+			break;
+		if (p_high == high && __atomic_compare_exchange_n(&label[high], &p_high, low, 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+
+		p1 = label_load(label, label_load(label, high));
+		p2 = label_load(label, low);
+	}
+}
+
+static void cc_init(cc_state_t *s, unsigned int first, unsigned int last)
+{
+	for (unsigned int u = first; u < last; u++) {
+		s->cc->label[u] = u;
+		s->cc->size[u] = 0;
+		s->cc->sum[u] = 0;
+	}
+}
+
+/* Link every node to its neighbour number 's->round', if it has one. */
+static void cc_link_round(cc_state_t *s, unsigned int first, unsigned int last)
+{
+	os_graph_t *graph = s->graph;
+
+	for (unsigned int u = first; u < last; u++) {
+		os_neighbour_iter_t it;
+		unsigned int v;
+
+		if (s->round >= graph_degree(graph, u))
+			continue;
+
+		graph_iter_init(&it, graph, u);
+		for (unsigned int i = 0; graph_iter_next(&it, v); i++) {
+			if (i == s->round) {
+				cc_link(s->cc->label, u, v);
+				break;
+			}
+		}
+	}
+}
+
+/* Link the neighbours left, except for the nodes of the largest component. */
+static void cc_link_rest(cc_state_t *s, unsigned int first, unsigned int last)
+{
+	os_graph_t *graph = s->graph;
+
+	for (unsigned int u = first; u < last; u++) {
+		os_neighbour_iter_t it;
+		unsigned int v;
+
+		if (label_load(s->cc->label, u) == s->giant)
+			continue;
+
+		graph_iter_init(&it, graph, u);
+		for (unsigned int i = 0; graph_iter_next(&it, v); i++)
+			if (i >= CC_NEIGHBOUR_ROUNDS)
+				cc_link(s->cc->label, u, v);
+	}
+}
+
+/* Point every node straight to its root. */
+static void cc_compress(cc_state_t *s, unsigned int first, unsigned int last)
+{
+	unsigned int *label = s->cc->label;
+
+	for (unsigned int u = first; u < last; u++) {
+		unsigned int l = label_load(label, u);
+		unsigned int root;
+
+		while ((root = label_load(label, l)) != l)
+			l = root;
+		__atomic_store_n(&label[u], l, __ATOMIC_RELAXED);
+	}
+}
+
+static void cc_tally_run(os_components_t *cc, unsigned int label, unsigned int size, long long sum)
+{
+	__atomic_fetch_add(&cc->size[label], size, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&cc->sum[label], sum, __ATOMIC_RELAXED);
+}
+
+/*
+ * Add up the sizes and sums of the components. Nearby nodes tend to share
+ * a label, so runs of them are added at once, to touch the shared
+ * counters of a large component less often.
+ */
+static void cc_tally(cc_state_t *s, unsigned int first, unsigned int last)
+{
+	os_components_t *cc = s->cc;
+	unsigned int run_label = cc->label[first], run_size = 0, roots = 0;
+	long long run_sum = 0;
+
+	for (unsigned int u = first; u < last; u++) {
+		if (cc->label[u] != run_label) {
+			cc_tally_run(cc, run_label, run_size, run_sum);
+			run_label = cc->label[u];
+			run_size = 0;
+			run_sum = 0;
+		}
+
+		run_size++;
+		run_sum += s->graph->values[u];
+		roots += run_label == u;
+	}
+	cc_tally_run(cc, run_label, run_size, run_sum);
+
+	__atomic_fetch_add(&cc->count, roots, __ATOMIC_RELAXED);
+}
+
+static void cc_chunk_function(void *arg, unsigned long first, unsigned long last)
+{
+	cc_state_t *s = (cc_state_t *) arg;
+
+	s->kernel(s, first, last);
+}
+
+/* Run one step over all the nodes on the threadpool and wait for it. */
+static void cc_run(os_threadpool_t *tp, cc_state_t *s, cc_kernel_t kernel)
+{
+	s->kernel = kernel;
+	parallel_for(tp, 0, s->graph->num_nodes, s->nodes_per_chunk, cc_chunk_function, s);
+}
+
+static int cmp_labels(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+	return (x > y) - (x < y);
+}
+
+/* Guess the label of the largest component from a sample of the nodes. */
+static unsigned int cc_sample_giant(cc_state_t *s)
+{
+	unsigned int sample[CC_SAMPLES];
+	unsigned int seed = 2654435761u;
+	unsigned int giant = 0, best = 0, run = 0;
+
+	for (unsigned int i = 0; i < CC_SAMPLES; i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		sample[i] = s->cc->label[seed % s->graph->num_nodes];
+	}
+
+	/* The most frequent label is the longest run once sorted. */
+	qsort(sample, CC_SAMPLES, sizeof(*sample), cmp_labels);
+	for (unsigned int i = 0; i < CC_SAMPLES; i++) {
+		run = i > 0 && sample[i] == sample[i - 1] ? run + 1 : 1;
+		if (run > best) {
+			best = run;
+			giant = sample[i];
+		}
+	}
+
+	return giant;
+}
+
+/*
+ * Label all the connected components of 'graph' on the threads of 'tp',
+ * and add up their sizes and sums.
+ */
+os_components_t *cc_label(os_threadpool_t *tp, os_graph_t *graph)
+{
+	os_components_t *cc = create_components(graph->num_nodes);
+	cc_state_t s;
+
+	if (graph->num_nodes == 0)
+		return cc;
+
+	s.graph = graph;
+	s.cc = cc;
+	s.nodes_per_chunk = (graph->num_nodes - 1) / (tp->num_threads * CC_CHUNKS_PER_THREAD) + 1;
+
+	cc_run(tp, &s, cc_init);
+
+	for (s.round = 0; s.round < CC_NEIGHBOUR_ROUNDS; s.round++) {
+		cc_run(tp, &s, cc_link_round);
+		cc_run(tp, &s, cc_compress);
+	}
+
+	s.giant = cc_sample_giant(&s);
+	cc_run(tp, &s, cc_link_rest);
+	cc_run(tp, &s, cc_compress);
+
+	cc_run(tp, &s, cc_tally);
+
+	return cc;
+}
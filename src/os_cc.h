@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Parallel connected components, by concurrent union-find over the edges
+ * with the sampling of Afforest, as described in:
+ * "Afforest: A Fast Concurrent Algorithm for Connected Components"
+ * (Sutton, Ben-Nun, Barak; IPDPS 2018).
+ *
+ * A few neighbours of every node are linked first, which is enough to
+ * form most of the largest component. Its label is then found by
+ * sampling, and the nodes already in it skip the rest of their edges:
+ * as every edge is stored at both ends, the other end links it anyway.
+ */
+
+#ifndef __OS_CC_H__
+#define __OS_CC_H__	1
+
+#include "os_graph.h"
+#include "os_threadpool.h"
+
+/* Neighbours of every node linked before looking for the largest component. */
+#define CC_NEIGHBOUR_ROUNDS	2
+/* Nodes sampled to find the largest component. */
+#define CC_SAMPLES		1024
+
+os_components_t *cc_label(os_threadpool_t *tp, os_graph_t *graph);
+
+#endif
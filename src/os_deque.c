@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+
+#include "os_deque.h"
+#include "log/log.h"
+#include "utils.h"
+
+static os_deque_array_t *deque_array_create(long size)
+{
+	os_deque_array_t *a;
+
+	a = malloc(sizeof(*a) + size * sizeof(a->buf[0]));
+	DIE(a == NULL, "malloc");
+
+	a->size = size;
+	a->retired = NULL;
+
+	return a;
+}
+
+static inline void *deque_array_get(os_deque_array_t *a, long i)
+{
+	return atomic_load_explicit(&a->buf[i & (a->size - 1)], memory_order_relaxed);
+}
+
+static inline void deque_array_put(os_deque_array_t *a, long i, void *item)
+{
+	atomic_store_explicit(&a->buf[i & (a->size - 1)], item, memory_order_relaxed);
+}
+
+/*
+ * Double the array of a full deque. Only the owner resizes. Thieves may
+ * still be reading the old array, so it is kept until deque_destroy().
+ */
+static os_deque_array_t *deque_grow(os_deque_t *d, os_deque_array_t *a, long top, long bottom)
+{
+	os_deque_array_t *n = deque_array_create(2 * a->size);
+
+	for (long i = top; i < bottom; i++)
+		deque_array_put(n, i, deque_array_get(a, i));
+	n->retired = a;
+
+	atomic_store_explicit(&d->array, n, memory_order_release);
+
+	return n;
+}
+
+/* Initialize an empty deque. 'size' must be a power of two. */
+void deque_init(os_deque_t *d, long size)
+{
+	atomic_init(&d->top, 0);
+	atomic_init(&d->bottom, 0);
+	atomic_init(&d->array, deque_array_create(size));
+}
+
+/* Free the deque arrays. Items still in the deque are not freed. */
+void deque_destroy(os_deque_t *d)
+{
+	os_deque_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+
+	while (a != NULL) {
+		os_deque_array_t *retired = a->retired;
+
+		free(a);
+		a = retired;
+	}
+}
+
+void deque_push(os_deque_t *d, void *item)
+{
+	long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+	long t = atomic_load_explicit(&d->top, memory_order_acquire);
+	os_deque_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+
+	if (b - t > a->size - 1)
+		a = deque_grow(d, a, t, b);
+
+	deque_array_put(a, b, item);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+/* Take the most recently pushed item. Return NULL if the deque is empty. */
+void *deque_take(os_deque_t *d)
+{
+	long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+	os_deque_array_t *a = atomic_load_explicit(&d->array, memory_order_relaxed);
+	void *item = NULL;
+	long t;
+
+	atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+	if (t <= b) {
+		item = deque_array_get(a, b);
+		if (t == b) {
+			/* Last item: race against thieves for it. */
+			if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+					memory_order_seq_cst, memory_order_relaxed))
+				item = NULL;
+			atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+		}
+	} else {
+		atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+	}
+
+	return item;
+}
+
+/* Number of items. Only an estimate, as thieves may take some meanwhile. */
+long deque_size(os_deque_t *d)
+{
+	long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+	long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+	return b > t ? b - t : 0;
+}
+
+/* Steal the oldest item. */
+void *deque_steal(os_deque_t *d)
+{
+	long t = atomic_load_explicit(&d->top, memory_order_acquire);
+	os_deque_array_t *a;
+	void *item;
+	long b;
+
+	atomic_thread_fence(memory_order_seq_cst);
+	b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+	if (t >= b)
+		return NULL;
+
+	a = atomic_load_explicit(&d->array, memory_order_acquire);
+	item = deque_array_get(a, t);
+	if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+			memory_order_seq_cst, memory_order_relaxed))
+		return DEQUE_ABORT;
+
+	return item;
+}
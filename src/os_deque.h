@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Chase-Lev work-stealing deque, as described in:
+ * "Correct and Efficient Work-Stealing for Weak Memory Models"
+ * (Le, Pop, Cohen, Zappa Nardelli; PPoPP 2013).
+ *
+ * The owner thread pushes and takes at the bottom end, without locking.
+ * Any other thread may steal from the top end.
+ */
+
+#ifndef __OS_DEQUE_H__
+#define __OS_DEQUE_H__	1
+
+#include <stdatomic.h>
+
+/* Circular array backing a deque. 'size' is a power of two. */
+typedef struct os_deque_array_t {
+	long size;
+	struct os_deque_array_t *retired; // Smaller array this one replaced
+	_Atomic(void *) buf[];
+} os_deque_array_t;
+
+typedef struct os_deque_t {
+	atomic_long top;
+	atomic_long bottom;
+	_Atomic(os_deque_array_t *) array;
+} os_deque_t;
+
+/* Returned by deque_steal() when it lost a race and should be retried. */
+#define DEQUE_ABORT	((void *) -1)
+
+void deque_init(os_deque_t *d, long size);
+void deque_destroy(os_deque_t *d);
+
+/* Owner side. */
+void deque_push(os_deque_t *d, void *item);
+void *deque_take(os_deque_t *d);
+long deque_size(os_deque_t *d);
+
+/* Thief side. Return NULL if empty, DEQUE_ABORT on a lost race. */
+void *deque_steal(os_deque_t *d);
+
+#endif
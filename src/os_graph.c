@@ -2,114 +2,465 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "os_graph.h"
+#include "os_graph_bin.h"
+#include "os_graph_scan.h"
 #include "log/log.h"
 #include "utils.h"
 
-/* Node functions */
-os_node_t *os_create_node(unsigned int id, int info)
-{
-	os_node_t *node;
-
-	node = malloc(sizeof(*node));
-	DIE(node == NULL, "mallloc");
-
-	node->id = id;
-	node->info = info;
-	node->num_neighbours = 0;
-	node->neighbours = NULL;
-
-	return node;
-}
-
-/* Graph functions */
+/*
+ * Graph functions. The edge weights are kept only if 'weighted', else
+ * every edge weighs 1.
+ */
 os_graph_t *create_graph_from_data(unsigned int num_nodes, unsigned int num_edges,
-		int *values, os_edge_t *edges)
+		int *values, os_edge_t *edges, int weighted)
 {
 	os_graph_t *graph;
+	unsigned long *offsets;
 
 	graph = malloc(sizeof(*graph));
 	DIE(graph == NULL, "mallloc");
 
 	graph->num_nodes = num_nodes;
 	graph->num_edges = num_edges;
+	graph->mapping = NULL;
+	graph->mapping_size = 0;
+	graph->perm = NULL;
+	graph->adj = NULL;
+	graph->adj_offsets = NULL;
 
-	graph->nodes = malloc(num_nodes * sizeof(os_node_t *));
-	DIE(graph->nodes == NULL, "malloc");
+	graph->values = malloc(num_nodes * sizeof(*graph->values));
+	DIE(graph->values == NULL && num_nodes != 0, "malloc");
+	memcpy(graph->values, values, num_nodes * sizeof(*graph->values));
 
-	for (unsigned int i = 0; i < graph->num_nodes; i++) {
-		graph->nodes[i] = os_create_node(i, values[i]);
-		graph->nodes[i]->neighbours = malloc(graph->num_nodes * sizeof(unsigned int));
-		DIE(graph->nodes[i]->neighbours == NULL, "malloc");
-		graph->nodes[i]->num_neighbours = 0;
+	/* Count the degree of every node into 'offsets[idx + 1]'. */
+	offsets = calloc(num_nodes + 1, sizeof(*offsets));
+	DIE(offsets == NULL, "calloc");
+
+	for (unsigned int i = 0; i < num_edges; i++) {
+		offsets[edges[i].src + 1]++;
+		offsets[edges[i].dst + 1]++;
 	}
 
-	for (unsigned int i = 0; i < graph->num_edges; i++) {
+	/* Prefix sum: 'offsets[idx]' is now the start of the list of 'idx'. */
+	for (unsigned int i = 0; i < num_nodes; i++)
+		offsets[i + 1] += offsets[i];
+
+	graph->neighbours = malloc(offsets[num_nodes] * sizeof(*graph->neighbours));
+	DIE(graph->neighbours == NULL && num_edges != 0, "malloc");
+	graph->weights = NULL;
+	if (weighted) {
+		graph->weights = malloc(offsets[num_nodes] * sizeof(*graph->weights));
+		DIE(graph->weights == NULL && num_edges != 0, "malloc");
+	}
+
+	/*
+	 * Scatter the edges, using 'offsets[idx]' as the insertion cursor of
+	 * 'idx'. Afterwards each cursor points to the start of the next list,
+	 * so shifting the array by one position restores the offsets.
+	 */
+	for (unsigned int i = 0; i < num_edges; i++) {
 		unsigned int isrc, idst;
+		unsigned long psrc, pdst;
 
 		isrc = edges[i].src;
 		idst = edges[i].dst;
-		graph->nodes[isrc]->neighbours[graph->nodes[isrc]->num_neighbours++] = idst;
-		graph->nodes[idst]->neighbours[graph->nodes[idst]->num_neighbours++] = isrc;
+		psrc = offsets[isrc]++;
+		pdst = offsets[idst]++;
+		graph->neighbours[psrc] = idst;
+		graph->neighbours[pdst] = isrc;
+		if (graph->weights != NULL) {
+			graph->weights[psrc] = edges[i].weight;
+			graph->weights[pdst] = edges[i].weight;
+		}
 	}
 
-	graph->visited = malloc(graph->num_nodes * sizeof(*graph->visited));
-	DIE(graph->visited == NULL, "malloc");
+	for (unsigned int i = num_nodes; i > 0; i--)
+		offsets[i] = offsets[i - 1];
+	offsets[0] = 0;
+	graph->offsets = offsets;
 
-	for (unsigned int i = 0; i < graph->num_nodes; i++)
-		graph->visited[i] = NOT_VISITED;
+	graph->visited = NULL;
 
 	return graph;
 }
 
-os_graph_t *create_graph_from_file(FILE *file)
+/*
+ * Allocate 'visited', every node NOT_VISITED, for the traversals that mark
+ * the nodes there. Graphs are built without it, as the others do not.
+ */
+void graph_alloc_visited(os_graph_t *graph)
 {
+	/* NOT_VISITED is 0, so untouched zero pages are already initialized. */
+	graph->visited = calloc(graph->num_nodes, sizeof(*graph->visited));
+	DIE(graph->visited == NULL && graph->num_nodes != 0, "calloc");
+}
+
+/*
+ * Parse the next (optionally negative) decimal integer.
+ * Numbers must be separated by blanks; anything else is reported as
+ * SCAN_BAD, leaving 's->line' at the offending line.
+ */
+int scan_number(graph_scanner_t *s, long long *val)
+{
+	const char *p = s->pos;
+	const char *end = s->end;
+	const char *digits;
+	unsigned long long v = 0;
+	int neg;
+
+	while (p < end && (*p == ' ' || *p == '\n' || *p == '\t' || *p == '\r')) {
+		s->line += (*p == '\n');
+		p++;
+	}
+
+	s->pos = p;
+	if (p == end)
+		return SCAN_EOF;
+
+	neg = (*p == '-');
+	p += neg;
+
+	digits = p;
+	while (p < end && (unsigned char)(*p - '0') <= 9) {
+		v = v * 10 + (unsigned char)(*p - '0');
+		p++;
+	}
+
+	if (p == digits || p - digits > SCAN_MAX_DIGITS)
+		return SCAN_BAD;
+	if (p < end && *p != ' ' && *p != '\n' && *p != '\t' && *p != '\r')
+		return SCAN_BAD;
+
+	s->pos = p;
+	*val = neg ? -(long long) v : (long long) v;
+
+	return SCAN_OK;
+}
+
+/* Check whether a number follows on the current line. */
+int scan_more_on_line(const graph_scanner_t *s)
+{
+	const char *p = s->pos;
+
+	while (p < s->end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		p++;
+
+	return p < s->end && *p != '\n';
+}
+
+/* Parse the next integer and check it is in [min, max]. Log on failure. */
+int scan_ranged(graph_scanner_t *s, long long min, long long max,
+		long long *val, const char *what)
+{
+	int rc = scan_number(s, val);
+
+	if (rc == SCAN_EOF) {
+		log_error("line %u: unexpected end of file, expected %s", s->line, what);
+		return -1;
+	}
+	if (rc == SCAN_BAD) {
+		log_error("line %u: malformed %s", s->line, what);
+		return -1;
+	}
+	if (*val < min || *val > max) {
+		log_error("line %u: %s %lld out of range [%lld, %lld]",
+				s->line, what, *val, min, max);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Build a graph out of its text representation held in memory, with
+ * 'build' if not NULL. The graph is weighted if the first edge has a
+ * third number, its weight; every edge must then have one.
+ */
+static os_graph_t *parse_graph(const char *buf, size_t len, os_graph_builder_t build, void *ctx)
+{
+	graph_scanner_t s = { .pos = buf, .end = buf + len, .line = 1 };
 	unsigned int num_nodes, num_edges;
-	unsigned int i;
-	int *nodes;
-	os_edge_t *edges;
+	long long val, src, dst, weight = 1;
+	int weighted = 0;
+	int *nodes = NULL;
+	os_edge_t *edges = NULL;
 	os_graph_t *graph = NULL;
 
-	if (fscanf(file, "%d %d", &num_nodes, &num_edges) == 0) {
-		log_error("Can't read from file");
+	if (scan_ranged(&s, 0, UINT_MAX, &val, "number of nodes") < 0)
 		goto out;
-	}
+	num_nodes = val;
+	if (scan_ranged(&s, 0, UINT_MAX, &val, "number of edges") < 0)
+		goto out;
+	num_edges = val;
 
-	nodes = malloc(num_nodes * sizeof(int));
-	DIE(nodes == NULL, "malloc");
-	for (i = 0; i < num_nodes; i++) {
-		if (fscanf(file, "%d", &nodes[i]) == 0) {
-			log_error("Can't read from file");
-			goto free_nodes;
-		}
+	nodes = malloc(num_nodes * sizeof(*nodes));
+	DIE(nodes == NULL && num_nodes != 0, "malloc");
+	for (unsigned int i = 0; i < num_nodes; i++) {
+		if (scan_ranged(&s, INT_MIN, INT_MAX, &val, "node value") < 0)
+			goto out;
+		nodes[i] = val;
 	}
 
-	edges = malloc(num_edges * sizeof(os_edge_t));
-	DIE(edges == NULL, "malloc");
-	for (i = 0; i < num_edges; ++i) {
-		if (fscanf(file, "%d %d", &edges[i].src, &edges[i].dst) == 0) {
-			log_error("Can't read from file");
-			goto free_edges;
-		}
+	edges = malloc(num_edges * sizeof(*edges));
+	DIE(edges == NULL && num_edges != 0, "malloc");
+	for (unsigned int i = 0; i < num_edges; i++) {
+		if (scan_ranged(&s, 0, (long long) num_nodes - 1, &src, "edge source") < 0 ||
+		    scan_ranged(&s, 0, (long long) num_nodes - 1, &dst, "edge destination") < 0)
+			goto out;
+		if (i == 0)
+			weighted = scan_more_on_line(&s);
+		if (weighted && scan_ranged(&s, 0, UINT_MAX, &weight, "edge weight") < 0)
+			goto out;
+		edges[i].src = src;
+		edges[i].dst = dst;
+		edges[i].weight = weight;
 	}
 
-	graph = create_graph_from_data(num_nodes, num_edges, nodes, edges);
+	if (scan_number(&s, &val) != SCAN_EOF)
+		log_warn("line %u: ignoring data after the last edge", s.line);
 
-free_edges:
+	if (build != NULL)
+		graph = build(ctx, num_nodes, num_edges, nodes, edges, weighted);
+	else
+		graph = create_graph_from_data(num_nodes, num_edges, nodes, edges, weighted);
+
+out:
 	free(edges);
-free_nodes:
 	free(nodes);
-out:
 	return graph;
 }
 
+/* Read the rest of a non-mappable stream (e.g. a pipe) into memory. */
+static char *read_stream(FILE *file, size_t *len)
+{
+	size_t cap = 1 << 16;
+	size_t n = 0;
+	char *buf;
+
+	buf = malloc(cap);
+	DIE(buf == NULL, "malloc");
+
+	while (1) {
+		n += fread(buf + n, 1, cap - n, file);
+		if (n < cap)
+			break;
+		cap *= 2;
+		buf = realloc(buf, cap);
+		DIE(buf == NULL, "realloc");
+	}
+	DIE(ferror(file), "fread");
+
+	*len = n;
+	return buf;
+}
+
+/*
+ * Load a graph from 'file', starting at its current position.
+ * Binary files (see os_graph_bin.h) are mapped and used in place.
+ * Text files are parsed: regular files are mapped in memory and parsed in
+ * place; other streams are read into a buffer first.
+ * Return NULL (after logging the reason) on malformed input.
+ */
+os_graph_t *create_graph_from_file(FILE *file)
+{
+	return create_graph_from_file_with(file, NULL, NULL);
+}
+
+/*
+ * Same as create_graph_from_file(), but text files are turned into a
+ * graph by 'build', if not NULL, instead of create_graph_from_data().
+ */
+os_graph_t *create_graph_from_file_with(FILE *file, os_graph_builder_t build, void *ctx)
+{
+	os_graph_t *graph;
+	struct stat st;
+	off_t start;
+	char *map;
+	size_t len;
+	int rc;
+
+	if (graph_file_is_binary(file))
+		return create_graph_from_binary(file, 0);
+
+	start = ftello(file);
+	rc = fstat(fileno(file), &st);
+	DIE(rc < 0, "fstat");
+
+	if (!S_ISREG(st.st_mode) || start < 0 || st.st_size <= start) {
+		map = read_stream(file, &len);
+		graph = parse_graph(map, len, build, ctx);
+		free(map);
+		return graph;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	DIE(map == MAP_FAILED, "mmap");
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+	graph = parse_graph(map + start, st.st_size - start, build, ctx);
+
+	rc = munmap(map, st.st_size);
+	DIE(rc < 0, "munmap");
+
+	return graph;
+}
+
+void destroy_graph(os_graph_t *graph)
+{
+	if (graph == NULL)
+		return;
+
+	if (graph->mapping != NULL) {
+		munmap(graph->mapping, graph->mapping_size);
+	} else {
+		free(graph->offsets);
+		free(graph->neighbours);
+		free(graph->values);
+		free(graph->perm);
+		free(graph->weights);
+	}
+	free(graph->adj);
+	free(graph->adj_offsets);
+	free(graph->visited);
+	free(graph);
+}
+
 void print_graph(os_graph_t *graph)
 {
 	for (unsigned int i = 0; i < graph->num_nodes; i++) {
+		os_neighbour_iter_t it;
+		unsigned int v;
+
 		printf("[%d]: ", i);
-		for (unsigned int j = 0; j < graph->nodes[i]->num_neighbours; j++)
-			printf("%d ", graph->nodes[i]->neighbours[j]);
+		graph_iter_init(&it, graph, i);
+		while (graph_iter_next(&it, v))
+			printf("%d ", v);
 		printf("\n");
 	}
 }
+
+static int cmp_nodes(const void *a, const void *b)
+{
+	unsigned int x = *(const unsigned int *) a, y = *(const unsigned int *) b;
+
+	return (x > y) - (x < y);
+}
+
+static int cmp_keys(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *) a, y = *(const unsigned long *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Sort a neighbour list, along with its weights if 'weights' is not NULL:
+ * by node, then by weight. 'keys' is room for 'degree' entries, only
+ * used with weights.
+ */
+void sort_neighbours(unsigned int *neighbours, unsigned int *weights, unsigned long degree,
+		unsigned long *keys)
+{
+	if (weights == NULL) {
+		qsort(neighbours, degree, sizeof(*neighbours), cmp_nodes);
+		return;
+	}
+
+	/* Node in the high half, weight in the low one. */
+	for (unsigned long i = 0; i < degree; i++)
+		keys[i] = (unsigned long) neighbours[i] << 32 | weights[i];
+	qsort(keys, degree, sizeof(*keys), cmp_keys);
+	for (unsigned long i = 0; i < degree; i++) {
+		neighbours[i] = keys[i] >> 32;
+		weights[i] = (unsigned int) keys[i];
+	}
+}
+
+/*
+ * Print one "node distance" line for every node reached by a shortest
+ * path search, by input ID. 'dist' is indexed by node.
+ */
+void print_distances(const os_graph_t *graph, const unsigned long *dist)
+{
+	unsigned long *by_input = NULL;
+
+	if (graph->perm != NULL) {
+		by_input = malloc(graph->num_nodes * sizeof(*by_input));
+		DIE(by_input == NULL && graph->num_nodes != 0, "malloc");
+		for (unsigned int i = 0; i < graph->num_nodes; i++)
+			by_input[graph->perm[i]] = dist[i];
+		dist = by_input;
+	}
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		if (dist[i] != GRAPH_UNREACHABLE)
+			printf("%u %lu\n", i, dist[i]);
+
+	free(by_input);
+}
+
+/*
+ * Print the rank of every node, by input ID. Seven significant digits:
+ * the parallel sums may round differently in the last bits.
+ */
+void print_ranks(const os_graph_t *graph, const double *rank)
+{
+	double *by_input = NULL;
+
+	if (graph->perm != NULL) {
+		by_input = malloc(graph->num_nodes * sizeof(*by_input));
+		DIE(by_input == NULL && graph->num_nodes != 0, "malloc");
+		for (unsigned int i = 0; i < graph->num_nodes; i++)
+			by_input[graph->perm[i]] = rank[i];
+		rank = by_input;
+	}
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		printf("%u %.6e\n", i, rank[i]);
+
+	free(by_input);
+}
+
+/* Allocate components for a graph of 'num_nodes' nodes, to be filled in. */
+os_components_t *create_components(unsigned int num_nodes)
+{
+	os_components_t *cc;
+
+	cc = malloc(sizeof(*cc));
+	DIE(cc == NULL, "malloc");
+
+	cc->num_nodes = num_nodes;
+	cc->count = 0;
+	cc->label = malloc(num_nodes * sizeof(*cc->label));
+	cc->size = malloc(num_nodes * sizeof(*cc->size));
+	cc->sum = malloc(num_nodes * sizeof(*cc->sum));
+	DIE(num_nodes != 0 && (cc->label == NULL || cc->size == NULL || cc->sum == NULL), "malloc");
+
+	return cc;
+}
+
+void destroy_components(os_components_t *cc)
+{
+	if (cc == NULL)
+		return;
+
+	free(cc->label);
+	free(cc->size);
+	free(cc->sum);
+	free(cc);
+}
+
+/* Print the number of components, then one "label size sum" line for each. */
+void print_components(os_components_t *cc)
+{
+	printf("%u\n", cc->count);
+	for (unsigned int i = 0; i < cc->num_nodes; i++)
+		if (cc->label[i] == i)
+			printf("%u %u %lld\n", i, cc->size[i], cc->sum[i]);
+}
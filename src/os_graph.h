@@ -4,35 +4,218 @@
 #define __OS_GRAPH_H__	1
 
 #include <stdio.h>
-
-typedef struct os_node_t {
-	unsigned int id;
-	int info;
-
-	unsigned int num_neighbours;
-	unsigned int *neighbours;
-} os_node_t;
+#include <limits.h>
 
 typedef struct os_graph_t {
 	unsigned int num_nodes;
 	unsigned int num_edges;
 
-	os_node_t **nodes;
+	/*
+	 * Compressed sparse row (CSR) adjacency.
+	 * The neighbours of node 'i' are stored contiguously in
+	 * 'neighbours[offsets[i]]' .. 'neighbours[offsets[i + 1] - 1]'.
+	 * 'offsets' has 'num_nodes + 1' entries. Every (undirected) edge is
+	 * stored once for each of its ends, so 'neighbours' holds
+	 * '2 * num_edges' entries.
+	 */
+	unsigned long *offsets;
+	unsigned int *neighbours;
+
+	/*
+	 * Weight of each adjacency entry, indexed like 'neighbours' (both ends
+	 * of an edge carry its weight), or NULL if every edge weighs 1.
+	 * Compressed lists keep their weights in their (sorted) order.
+	 */
+	unsigned int *weights;
+
+	/*
+	 * Compressed adjacency (see os_graph_compress.h), in place of
+	 * 'neighbours' when not NULL: the list of node 'i' is encoded from
+	 * 'adj[adj_offsets[i]]' on. 'offsets' still gives the degrees.
+	 * Read either form with an os_neighbour_iter_t.
+	 */
+	unsigned char *adj;
+	unsigned long *adj_offsets;
+
+	int *values; // Value ('info') of each node
+
+	/*
+	 * Node ID in the input of each node, when the nodes were relabelled
+	 * (see os_graph_order.h), or NULL if they keep their input IDs.
+	 */
+	unsigned int *perm;
+
+	/* Traversal state, NULL until graph_alloc_visited(). */
 	enum {
 		NOT_VISITED = 0,
 		PROCESSING = 1,
 		DONE = 2
 	} *visited;
+
+	/*
+	 * Memory mapped binary file backing 'offsets', 'neighbours', 'values'
+	 * and 'weights', or NULL if they are heap allocated.
+	 */
+	void *mapping;
+	size_t mapping_size;
 } os_graph_t;
 
 typedef struct os_edge_t {
 	unsigned int src, dst;
+	unsigned int weight; // 1 in unweighted graphs
 } os_edge_t;
 
-os_node_t *os_create_node(unsigned int id, int info);
+/* Distance of the nodes a shortest path search does not reach. */
+#define GRAPH_UNREACHABLE	ULONG_MAX
+
+/*
+ * PageRank, shared by the serial and the parallel implementation: the
+ * damping factor, and the iterations run at most (unless given). Ranks
+ * have converged once none of them changes by more than
+ * GRAPH_PAGERANK_EPSILON times the mean rank in an iteration.
+ */
+#define GRAPH_PAGERANK_DAMPING		0.85
+#define GRAPH_PAGERANK_ITERATIONS	100
+#define GRAPH_PAGERANK_EPSILON		1e-6
+
+/*
+ * Connected components of a graph. Each component is labeled with its
+ * smallest node. 'size' and 'sum' are indexed by label, so they only hold
+ * meaningful values at the nodes 'i' with 'label[i] == i'.
+ */
+typedef struct os_components_t {
+	unsigned int num_nodes;
+	unsigned int count; // Number of components
+	unsigned int *label; // Component label of each node
+	unsigned int *size; // Number of nodes of each component
+	long long *sum; // Sum of the node values of each component
+} os_components_t;
+
+/* Number of neighbours of node 'idx'. */
+static inline unsigned int graph_degree(const os_graph_t *graph, unsigned int idx)
+{
+	return graph->offsets[idx + 1] - graph->offsets[idx];
+}
+
+/* First neighbour of node 'idx'; there are graph_degree() of them. */
+static inline unsigned int *graph_neighbours(const os_graph_t *graph, unsigned int idx)
+{
+	return graph->neighbours + graph->offsets[idx];
+}
+
+/*
+ * Weight of the adjacency entry 'pos': the one of the neighbour met
+ * 'j'-th in the list of node 'idx' is at 'offsets[idx] + j'.
+ */
+static inline unsigned int graph_weight(const os_graph_t *graph, unsigned long pos)
+{
+	return graph->weights != NULL ? graph->weights[pos] : 1;
+}
+
+/*
+ * Cursor over the neighbours of a node, plain or compressed:
+ *
+ *	os_neighbour_iter_t it;
+ *	unsigned int v;
+ *
+ *	graph_iter_init(&it, graph, idx);
+ *	while (graph_iter_next(&it, v))
+ *		...
+ *
+ * Compressed lists are sorted; plain ones are in their stored order.
+ */
+typedef struct os_neighbour_iter {
+	const unsigned int *pos; // Plain: next neighbour
+	const unsigned int *end; // Plain: end of the list
+	const unsigned char *bytes; // Compressed: next code, NULL for plain lists
+	unsigned int left; // Compressed: neighbours not decoded yet
+	unsigned int last; // Compressed: last neighbour decoded, the node itself at first
+	int first; // Compressed: the next code is the first of the list
+} os_neighbour_iter_t;
+
+static inline void graph_iter_init(os_neighbour_iter_t *it, const os_graph_t *graph,
+		unsigned int idx)
+{
+	/* Every field set either way, or optimized builds warn of the unused ones. */
+	if (graph->adj == NULL) {
+		it->pos = graph_neighbours(graph, idx);
+		it->end = it->pos + graph_degree(graph, idx);
+		it->bytes = NULL;
+		it->left = 0;
+		it->last = idx;
+		it->first = 0;
+	} else {
+		it->pos = NULL;
+		it->end = NULL;
+		it->bytes = graph->adj + graph->adj_offsets[idx];
+		it->left = graph_degree(graph, idx);
+		it->last = idx;
+		it->first = 1;
+	}
+}
+
+/*
+ * Decode the next compressed neighbour into '*node'. Return 0 at the end.
+ * Codes are LEB128 varints: the first is the zigzagged difference from
+ * the node itself, the others the (non-negative) difference from the
+ * previous neighbour.
+ */
+static inline int graph_iter_decode(os_neighbour_iter_t *it, unsigned int *node)
+{
+	unsigned int code = 0, shift = 0;
+	unsigned char byte;
+
+	if (it->left == 0)
+		return 0;
+	it->left--;
+
+	do {
+		byte = *it->bytes++;
+		code |= (unsigned int) (byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	if (it->first) {
+		it->first = 0;
+		it->last += (code & 1) ? ~(code >> 1) : code >> 1;
+	} else {
+		it->last += code;
+	}
+	*node = it->last;
+
+	return 1;
+}
+
+/*
+ * Store the next neighbour in the lvalue 'node'. Return 0 at the end.
+ * A macro, so that plain lists are read inline whatever the optimization.
+ */
+#define graph_iter_next(it, node) \
+	((it)->bytes == NULL ? \
+		((it)->pos < (it)->end ? ((node) = *(it)->pos++, 1) : 0) : \
+		graph_iter_decode((it), &(node)))
+
+/*
+ * Build a graph out of parsed nodes and edges, like create_graph_from_data().
+ * 'ctx' is passed through from create_graph_from_file_with().
+ */
+typedef os_graph_t *(*os_graph_builder_t)(void *ctx, unsigned int num_nodes,
+		unsigned int num_edges, int *values, os_edge_t *edges, int weighted);
+
 os_graph_t *create_graph_from_data(unsigned int num_nodes, unsigned int num_edges,
-		int *values, os_edge_t *edges);
+		int *values, os_edge_t *edges, int weighted);
 os_graph_t *create_graph_from_file(FILE *file);
+os_graph_t *create_graph_from_file_with(FILE *file, os_graph_builder_t build, void *ctx);
+void destroy_graph(os_graph_t *graph);
+void graph_alloc_visited(os_graph_t *graph);
 void print_graph(os_graph_t *graph);
+void sort_neighbours(unsigned int *neighbours, unsigned int *weights, unsigned long degree,
+		unsigned long *keys);
+void print_distances(const os_graph_t *graph, const unsigned long *dist);
+void print_ranks(const os_graph_t *graph, const double *rank);
+
+os_components_t *create_components(unsigned int num_nodes);
+void destroy_components(os_components_t *cc);
+void print_components(os_components_t *cc);
 
 #endif
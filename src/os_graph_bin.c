@@ -0,0 +1,470 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "os_graph.h"
+#include "os_graph_bin.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* The mapped sections are used in place, so the types must match. */
+_Static_assert(sizeof(unsigned long) == sizeof(uint64_t), "offsets type");
+_Static_assert(sizeof(unsigned int) == sizeof(uint32_t), "neighbours type");
+_Static_assert(sizeof(int) == sizeof(int32_t), "values type");
+
+#define ALIGN_UP(x, a)		(((x) + (a) - 1) / (a) * (a))
+
+#define CHECKSUM_SEED		0xcbf29ce484222325ULL
+#define CHECKSUM_PRIME		0x100000001b3ULL
+
+/* Mix 'len / 8' 64-bit words into the running checksum 'h'. */
+static uint64_t checksum_words(uint64_t h, const uint64_t *words, size_t len)
+{
+	for (size_t i = 0; i < len / sizeof(*words); i++) {
+		h = (h ^ words[i]) * CHECKSUM_PRIME;
+		h ^= h >> 29;
+	}
+
+	return h;
+}
+
+/* Mix 'len' bytes, zero extended to a multiple of 8, into 'h'. */
+static uint64_t checksum_bytes(uint64_t h, const void *buf, size_t len)
+{
+	size_t whole = len / sizeof(uint64_t) * sizeof(uint64_t);
+	uint64_t tail = 0;
+
+	h = checksum_words(h, buf, whole);
+	if (whole != len) {
+		memcpy(&tail, (const char *) buf + whole, len - whole);
+		h = checksum_words(h, &tail, sizeof(tail));
+	}
+
+	return h;
+}
+
+/* Mix a section of 'len' bytes, zero padded up to 'padded_len', into 'h'. */
+static uint64_t checksum_section(uint64_t h, const void *buf, size_t len, size_t padded_len)
+{
+	static const uint64_t zero;
+
+	h = checksum_bytes(h, buf, len);
+	for (size_t off = ALIGN_UP(len, sizeof(zero)); off < padded_len; off += sizeof(zero))
+		h = checksum_words(h, &zero, sizeof(zero));
+
+	return h;
+}
+
+/* Size of the header of a given version. */
+static size_t header_size(uint32_t version)
+{
+	switch (version) {
+	case 1:
+		return offsetof(os_graph_bin_header_t, perm_off);
+	case 2:
+		return offsetof(os_graph_bin_header_t, weights_off);
+	default:
+		return sizeof(os_graph_bin_header_t);
+	}
+}
+
+/* Header flags a given version may have. */
+static uint32_t version_flags(uint32_t version)
+{
+	switch (version) {
+	case 1:
+		return 0;
+	case 2:
+		return GRAPH_BIN_PERMUTED;
+	default:
+		return GRAPH_BIN_PERMUTED | GRAPH_BIN_WEIGHTED;
+	}
+}
+
+static uint64_t header_checksum(const os_graph_bin_header_t *hdr)
+{
+	os_graph_bin_header_t tmp = *hdr;
+
+	tmp.data_checksum = 0;
+	tmp.header_checksum = 0;
+
+	return checksum_bytes(CHECKSUM_SEED, &tmp, header_size(hdr->version));
+}
+
+/* Fill in the identification and the section layout of a header. */
+static void graph_bin_layout(os_graph_bin_header_t *hdr, uint64_t num_nodes, uint64_t num_edges,
+		uint32_t flags)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->magic, GRAPH_BIN_MAGIC, sizeof(GRAPH_BIN_MAGIC));
+	hdr->version = GRAPH_BIN_VERSION;
+	hdr->flags = flags;
+	hdr->num_nodes = num_nodes;
+	hdr->num_edges = num_edges;
+
+	hdr->offsets_off = ALIGN_UP(sizeof(*hdr), GRAPH_BIN_ALIGN);
+	hdr->neighbours_off = ALIGN_UP(hdr->offsets_off + (num_nodes + 1) * sizeof(uint64_t),
+			GRAPH_BIN_ALIGN);
+	hdr->values_off = ALIGN_UP(hdr->neighbours_off + 2 * num_edges * sizeof(uint32_t),
+			GRAPH_BIN_ALIGN);
+	hdr->file_size = ALIGN_UP(hdr->values_off + num_nodes * sizeof(int32_t),
+			GRAPH_BIN_ALIGN);
+
+	if (flags & GRAPH_BIN_PERMUTED) {
+		hdr->perm_off = hdr->file_size;
+		hdr->file_size = ALIGN_UP(hdr->perm_off + num_nodes * sizeof(uint32_t),
+				GRAPH_BIN_ALIGN);
+	}
+
+	if (flags & GRAPH_BIN_WEIGHTED) {
+		hdr->weights_off = hdr->file_size;
+		hdr->file_size = ALIGN_UP(hdr->weights_off + 2 * num_edges * sizeof(uint32_t),
+				GRAPH_BIN_ALIGN);
+	}
+}
+
+/* Check whether 'file' holds a binary graph, starting at its current position. */
+int graph_file_is_binary(FILE *file)
+{
+	char magic[sizeof(GRAPH_BIN_MAGIC)];
+	off_t start = ftello(file);
+
+	if (start < 0)
+		return 0;
+	if (pread(fileno(file), magic, sizeof(magic), start) != sizeof(magic))
+		return 0;
+
+	return memcmp(magic, GRAPH_BIN_MAGIC, sizeof(magic)) == 0;
+}
+
+/*
+ * Check the offsets start at 0, never decrease and end at the size of the
+ * adjacency, so that every list is within it: done on every load.
+ */
+static int graph_bin_check_offsets(const os_graph_t *graph)
+{
+	if (graph->offsets[0] != 0 || graph->offsets[graph->num_nodes] != 2UL * graph->num_edges)
+		return -1;
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		if (graph->offsets[i] > graph->offsets[i + 1])
+			return -1;
+
+	return 0;
+}
+
+/*
+ * Check the neighbours are nodes, and that 'perm' is a permutation: only
+ * done along with the data checksum.
+ */
+static int graph_bin_check_arrays(const os_graph_t *graph)
+{
+	unsigned char *seen;
+	int rc = 0;
+
+	for (unsigned long i = 0; i < 2UL * graph->num_edges; i++)
+		if (graph->neighbours[i] >= graph->num_nodes)
+			return -1;
+
+	if (graph->perm == NULL)
+		return 0;
+
+	seen = calloc(graph->num_nodes, sizeof(*seen));
+	DIE(seen == NULL && graph->num_nodes != 0, "calloc");
+	for (unsigned int i = 0; i < graph->num_nodes && rc == 0; i++) {
+		if (graph->perm[i] >= graph->num_nodes || seen[graph->perm[i]])
+			rc = -1;
+		else
+			seen[graph->perm[i]] = 1;
+	}
+	free(seen);
+
+	return rc;
+}
+
+/*
+ * Map a binary graph file and use its sections in place.
+ * Nothing is allocated but the graph itself, and only the offsets are
+ * read, to check them, unless 'verify' asks for the data checksum and
+ * the other CSR arrays to be checked too.
+ * Return NULL (after logging the reason) on malformed input.
+ */
+os_graph_t *create_graph_from_binary(FILE *file, int verify)
+{
+	os_graph_bin_header_t expected;
+	os_graph_bin_header_t *hdr;
+	os_graph_t *graph;
+	struct stat st;
+	char *map;
+	int rc;
+
+	if (ftello(file) != 0) {
+		log_error("Binary graphs must start at the beginning of the file");
+		return NULL;
+	}
+
+	rc = fstat(fileno(file), &st);
+	DIE(rc < 0, "fstat");
+	if ((size_t) st.st_size < sizeof(*hdr)) {
+		log_error("Binary graph file is truncated");
+		return NULL;
+	}
+
+	/* Private and writable: node values may be changed, never written back. */
+	map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fileno(file), 0);
+	DIE(map == MAP_FAILED, "mmap");
+	hdr = (os_graph_bin_header_t *) map;
+
+	if (memcmp(hdr->magic, GRAPH_BIN_MAGIC, sizeof(GRAPH_BIN_MAGIC)) != 0) {
+		log_error("Not a binary graph file");
+		goto unmap;
+	}
+	if (hdr->version < 1 || hdr->version > GRAPH_BIN_VERSION) {
+		log_error("Unsupported binary graph version %u", hdr->version);
+		goto unmap;
+	}
+	if (hdr->header_checksum != header_checksum(hdr)) {
+		log_error("Binary graph header checksum mismatch");
+		goto unmap;
+	}
+	if (hdr->num_nodes > UINT_MAX || hdr->num_edges > UINT_MAX ||
+	    (hdr->flags & ~version_flags(hdr->version)) != 0) {
+		log_error("Unsupported binary graph size or flags");
+		goto unmap;
+	}
+
+	graph_bin_layout(&expected, hdr->num_nodes, hdr->num_edges, hdr->flags);
+	if (hdr->offsets_off != expected.offsets_off ||
+	    hdr->neighbours_off != expected.neighbours_off ||
+	    hdr->values_off != expected.values_off ||
+	    (hdr->version >= 2 && hdr->perm_off != expected.perm_off) ||
+	    (hdr->version >= 3 && hdr->weights_off != expected.weights_off) ||
+	    hdr->file_size != expected.file_size) {
+		log_error("Unexpected binary graph layout");
+		goto unmap;
+	}
+	if ((uint64_t) st.st_size < hdr->file_size) {
+		log_error("Binary graph file is truncated");
+		goto unmap;
+	}
+
+	graph = malloc(sizeof(*graph));
+	DIE(graph == NULL, "malloc");
+
+	graph->num_nodes = hdr->num_nodes;
+	graph->num_edges = hdr->num_edges;
+	graph->offsets = (unsigned long *) (map + hdr->offsets_off);
+	graph->neighbours = (unsigned int *) (map + hdr->neighbours_off);
+	graph->values = (int *) (map + hdr->values_off);
+	graph->perm = (hdr->flags & GRAPH_BIN_PERMUTED) ? (unsigned int *) (map + hdr->perm_off) : NULL;
+	graph->weights = (hdr->flags & GRAPH_BIN_WEIGHTED) ?
+		(unsigned int *) (map + hdr->weights_off) : NULL;
+	graph->adj = NULL;
+	graph->adj_offsets = NULL;
+	graph->mapping = map;
+	graph->mapping_size = st.st_size;
+
+	if (graph_bin_check_offsets(graph) < 0) {
+		log_error("Corrupted binary graph offsets");
+		goto free_graph;
+	}
+
+	if (verify) {
+		uint64_t sum = checksum_words(CHECKSUM_SEED, (uint64_t *) (map + hdr->offsets_off),
+				hdr->file_size - hdr->offsets_off);
+
+		if (sum != hdr->data_checksum) {
+			log_error("Binary graph data checksum mismatch");
+			goto free_graph;
+		}
+		if (graph_bin_check_arrays(graph) < 0) {
+			log_error("Corrupted binary graph adjacency");
+			goto free_graph;
+		}
+	}
+
+	graph->visited = NULL;
+
+	return graph;
+
+free_graph:
+	free(graph);
+unmap:
+	munmap(map, st.st_size);
+	return NULL;
+}
+
+/* Write 'len' bytes of a section, zero padded up to 'padded_len'. */
+static int write_section(FILE *file, const void *buf, size_t len, size_t padded_len)
+{
+	static const char zeros[GRAPH_BIN_ALIGN];
+
+	if (len != 0 && fwrite(buf, 1, len, file) != len)
+		return -1;
+
+	for (size_t left = padded_len - len; left > 0; ) {
+		size_t n = left < sizeof(zeros) ? left : sizeof(zeros);
+
+		if (fwrite(zeros, 1, n, file) != n)
+			return -1;
+		left -= n;
+	}
+
+	return 0;
+}
+
+/* Store 'graph' in the binary format. Return 0 on success, -1 on I/O error. */
+int write_graph_binary(os_graph_t *graph, FILE *file)
+{
+	os_graph_bin_header_t hdr;
+	size_t offsets_len, neighbours_len, values_len, perm_len, weights_len;
+	uint64_t values_end, perm_end;
+	uint64_t sum;
+
+	graph_bin_layout(&hdr, graph->num_nodes, graph->num_edges,
+			(graph->perm != NULL ? GRAPH_BIN_PERMUTED : 0) |
+			(graph->weights != NULL ? GRAPH_BIN_WEIGHTED : 0));
+	perm_end = graph->weights != NULL ? hdr.weights_off : hdr.file_size;
+	values_end = graph->perm != NULL ? hdr.perm_off : perm_end;
+
+	offsets_len = (graph->num_nodes + 1UL) * sizeof(*graph->offsets);
+	neighbours_len = 2UL * graph->num_edges * sizeof(*graph->neighbours);
+	values_len = graph->num_nodes * sizeof(*graph->values);
+	perm_len = graph->num_nodes * sizeof(*graph->perm);
+	weights_len = 2UL * graph->num_edges * sizeof(*graph->weights);
+
+	sum = checksum_section(CHECKSUM_SEED, graph->offsets, offsets_len,
+			hdr.neighbours_off - hdr.offsets_off);
+	sum = checksum_section(sum, graph->neighbours, neighbours_len,
+			hdr.values_off - hdr.neighbours_off);
+	sum = checksum_section(sum, graph->values, values_len, values_end - hdr.values_off);
+	if (graph->perm != NULL)
+		sum = checksum_section(sum, graph->perm, perm_len, perm_end - hdr.perm_off);
+	if (graph->weights != NULL)
+		sum = checksum_section(sum, graph->weights, weights_len,
+				hdr.file_size - hdr.weights_off);
+
+	hdr.data_checksum = sum;
+	hdr.header_checksum = header_checksum(&hdr);
+
+	if (write_section(file, &hdr, sizeof(hdr), hdr.offsets_off) < 0 ||
+	    write_section(file, graph->offsets, offsets_len, hdr.neighbours_off - hdr.offsets_off) < 0 ||
+	    write_section(file, graph->neighbours, neighbours_len, hdr.values_off - hdr.neighbours_off) < 0 ||
+	    write_section(file, graph->values, values_len, values_end - hdr.values_off) < 0)
+		return -1;
+	if (graph->perm != NULL &&
+	    write_section(file, graph->perm, perm_len, perm_end - hdr.perm_off) < 0)
+		return -1;
+	if (graph->weights != NULL &&
+	    write_section(file, graph->weights, weights_len, hdr.file_size - hdr.weights_off) < 0)
+		return -1;
+
+	return fflush(file) == 0 ? 0 : -1;
+}
+
+os_graph_t *map_graph_binary_output(FILE *file, unsigned int num_nodes, unsigned int num_edges,
+		int weighted)
+{
+	os_graph_bin_header_t hdr;
+	os_graph_t *graph;
+	char *map;
+	int rc;
+
+	graph_bin_layout(&hdr, num_nodes, num_edges, weighted ? GRAPH_BIN_WEIGHTED : 0);
+
+	/* Any previous content must go, as the padding has to be zero. */
+	rc = ftruncate(fileno(file), 0);
+	DIE(rc < 0, "ftruncate");
+	rc = ftruncate(fileno(file), hdr.file_size);
+	DIE(rc < 0, "ftruncate");
+
+	map = mmap(NULL, hdr.file_size, PROT_READ | PROT_WRITE, MAP_SHARED, fileno(file), 0);
+	DIE(map == MAP_FAILED, "mmap");
+	memcpy(map, &hdr, sizeof(hdr));
+
+	graph = malloc(sizeof(*graph));
+	DIE(graph == NULL, "malloc");
+
+	graph->num_nodes = num_nodes;
+	graph->num_edges = num_edges;
+	graph->offsets = (unsigned long *) (map + hdr.offsets_off);
+	graph->neighbours = (unsigned int *) (map + hdr.neighbours_off);
+	graph->values = (int *) (map + hdr.values_off);
+	graph->perm = NULL;
+	graph->weights = weighted ? (unsigned int *) (map + hdr.weights_off) : NULL;
+	graph->adj = NULL;
+	graph->adj_offsets = NULL;
+	graph->visited = NULL;
+	graph->mapping = map;
+	graph->mapping_size = hdr.file_size;
+
+	return graph;
+}
+
+/* Checksum the sections filled in, and write the header. Return -1 on I/O error. */
+int finish_graph_binary_output(os_graph_t *graph)
+{
+	os_graph_bin_header_t *hdr = (os_graph_bin_header_t *) graph->mapping;
+
+	hdr->data_checksum = checksum_words(CHECKSUM_SEED,
+			(uint64_t *) ((char *) graph->mapping + hdr->offsets_off),
+			hdr->file_size - hdr->offsets_off);
+	hdr->header_checksum = header_checksum(hdr);
+
+	return msync(graph->mapping, graph->mapping_size, MS_SYNC);
+}
+
+/*
+ * Store 'graph' in the text format. Edges are listed by source node, so
+ * their order may differ from the file the graph was loaded from.
+ * The text format has no permutation, so relabelled nodes are written
+ * back with their input IDs. Weights, if any, follow their edge.
+ */
+int write_graph_text(os_graph_t *graph, FILE *file)
+{
+	unsigned int *rank = NULL; // Node of each input ID
+
+	if (graph->perm != NULL) {
+		rank = malloc(graph->num_nodes * sizeof(*rank));
+		DIE(rank == NULL && graph->num_nodes != 0, "malloc");
+		for (unsigned int i = 0; i < graph->num_nodes; i++)
+			rank[graph->perm[i]] = i;
+	}
+
+	fprintf(file, "%u %u\n", graph->num_nodes, graph->num_edges);
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		fprintf(file, i + 1 < graph->num_nodes ? "%d " : "%d",
+				graph->values[rank != NULL ? rank[i] : i]);
+	fprintf(file, "\n");
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++) {
+		unsigned int *neighbours = graph_neighbours(graph, i);
+		int self_loop = 0;
+
+		/* Each edge is stored at both ends, a self-loop twice at its node. */
+		for (unsigned int j = 0; j < graph_degree(graph, i); j++) {
+			if (neighbours[j] == i)
+				self_loop = !self_loop;
+			if (neighbours[j] < i || (neighbours[j] == i && !self_loop))
+				continue;
+
+			if (graph->perm != NULL)
+				fprintf(file, "%u %u", graph->perm[i], graph->perm[neighbours[j]]);
+			else
+				fprintf(file, "%u %u", i, neighbours[j]);
+			if (graph->weights != NULL)
+				fprintf(file, " %u", graph->weights[graph->offsets[i] + j]);
+			fprintf(file, "\n");
+		}
+	}
+	free(rank);
+
+	return fflush(file) == 0 && !ferror(file) ? 0 : -1;
+}
@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef __OS_GRAPH_BIN_H__
+#define __OS_GRAPH_BIN_H__	1
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "os_graph.h"
+
+/*
+ * Binary graph format.
+ *
+ * The file starts with an os_graph_bin_header_t, followed by the CSR
+ * sections of os_graph_t, in host byte order, each starting at a
+ * GRAPH_BIN_ALIGN aligned file offset and zero padded up to the next one:
+ *
+ *   offsets	(num_nodes + 1) x uint64_t
+ *   neighbours	(2 * num_edges) x uint32_t
+ *   values	num_nodes x int32_t
+ *   perm	num_nodes x uint32_t, with GRAPH_BIN_PERMUTED only
+ *   weights	(2 * num_edges) x uint32_t, with GRAPH_BIN_WEIGHTED only
+ *
+ * The sections are laid out exactly like the in-memory arrays, so a
+ * mapped file is used as is, without copying or parsing anything.
+ * 'header_checksum' covers the header (with both checksums zeroed) and is
+ * checked on every load, along with the offsets (see below). 'data_checksum'
+ * covers everything after the header; checking it reads the whole file, so
+ * it is only done on demand.
+ *
+ * The offsets must start at 0, never decrease and end at 2 * num_edges,
+ * which takes a pass over them on every load. The neighbour IDs (and
+ * 'perm') are trusted unless create_graph_from_binary() is asked to
+ * verify the file: a file corrupted past its header checksum may then
+ * make traversals read out of bounds.
+ *
+ * Version 2 added 'perm_off' and the 'perm' section, the input ID of each
+ * node of a relabelled graph. Version 3 added 'weights_off' and the
+ * 'weights' section, the weight of each neighbour. Files of the previous
+ * versions, whose header ends before the fields they lack, are still read.
+ */
+#define GRAPH_BIN_MAGIC		"OSGRAPH"
+#define GRAPH_BIN_VERSION	3
+#define GRAPH_BIN_ALIGN		64
+
+/* Header flags. */
+#define GRAPH_BIN_PERMUTED	(1 << 0) // The file has a 'perm' section
+#define GRAPH_BIN_WEIGHTED	(1 << 1) // The file has a 'weights' section
+
+typedef struct os_graph_bin_header_t {
+	char magic[8];
+	uint32_t version;
+	uint32_t flags; // GRAPH_BIN_* flags
+	uint64_t num_nodes;
+	uint64_t num_edges;
+
+	/* File offsets of the sections. */
+	uint64_t offsets_off;
+	uint64_t neighbours_off;
+	uint64_t values_off;
+	uint64_t file_size;
+
+	uint64_t data_checksum;
+	uint64_t header_checksum;
+
+	uint64_t perm_off; // 0 without GRAPH_BIN_PERMUTED
+	uint64_t weights_off; // 0 without GRAPH_BIN_WEIGHTED
+} os_graph_bin_header_t;
+
+int graph_file_is_binary(FILE *file);
+os_graph_t *create_graph_from_binary(FILE *file, int verify);
+int write_graph_binary(os_graph_t *graph, FILE *file);
+int write_graph_text(os_graph_t *graph, FILE *file);
+
+/*
+ * Write a binary graph in place: map_graph_binary_output() sizes 'file'
+ * and returns a graph whose arrays are its (shared, zeroed) sections, to
+ * be filled in by the caller, 'weights' included if 'weighted';
+ * finish_graph_binary_output() then writes the header. Free the graph
+ * with destroy_graph(). Graphs larger than memory can be written this
+ * way, without building them beforehand.
+ */
+os_graph_t *map_graph_binary_output(FILE *file, unsigned int num_nodes, unsigned int num_edges,
+		int weighted);
+int finish_graph_binary_output(os_graph_t *graph);
+
+#endif
@@ -0,0 +1,371 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "os_graph_build.h"
+#include "log/log.h"
+#include "utils.h"
+
+typedef struct build_state build_state_t;
+
+/* A step of the build, run for every chunk (or bucket) 'idx'. */
+typedef void (*build_kernel_t)(build_state_t *s, unsigned int idx);
+
+struct build_state {
+	os_graph_t *graph;
+	const int *values;
+	const os_edge_t *edges;
+	int flags;
+
+	unsigned int num_chunks; // Edge chunks, and node buckets as well
+	unsigned int edges_per_chunk;
+	unsigned int nodes_per_bucket;
+
+	/*
+	 * Edge ends of chunk 'c' in bucket 'b' at 'counts[c * num_chunks + b]'.
+	 * Once summed up, the position where the chunk writes the next one.
+	 */
+	unsigned long *counts;
+	unsigned long *bucket_start; // 'num_chunks + 1' entries
+	os_edge_t *ends; // Edge ends, from 'src', grouped by the bucket of 'src'
+
+	/* GRAPH_BUILD_SIMPLE only: neighbours kept by each bucket, and where they go. */
+	unsigned long *kept;
+	unsigned long *kept_start;
+	unsigned int *neighbours;
+	unsigned int *weights;
+
+	build_kernel_t kernel;
+};
+
+static inline unsigned int bucket_of(build_state_t *s, unsigned int node)
+{
+	return node / s->nodes_per_bucket;
+}
+
+static inline int skip_edge(build_state_t *s, const os_edge_t *e)
+{
+	return (s->flags & GRAPH_BUILD_SIMPLE) && e->src == e->dst;
+}
+
+/* Edges [first, last) of chunk 'c'. */
+static void chunk_edges(build_state_t *s, unsigned int c, unsigned long *first, unsigned long *last)
+{
+	*first = (unsigned long) c * s->edges_per_chunk;
+	*last = *first + s->edges_per_chunk;
+	if (*last > s->graph->num_edges)
+		*last = s->graph->num_edges;
+	if (*first > *last)
+		*first = *last;
+}
+
+/* Nodes [first, last) of bucket 'b'. */
+static void bucket_nodes(build_state_t *s, unsigned int b, unsigned int *first, unsigned int *last)
+{
+	unsigned long f = (unsigned long) b * s->nodes_per_bucket;
+	unsigned long l = f + s->nodes_per_bucket;
+
+	if (l > s->graph->num_nodes)
+		l = s->graph->num_nodes;
+	if (f > l)
+		f = l;
+	*first = f;
+	*last = l;
+}
+
+/* Count the edge ends of chunk 'c' falling into each bucket. */
+static void build_count(build_state_t *s, unsigned int c)
+{
+	unsigned long *counts = &s->counts[(unsigned long) c * s->num_chunks];
+	unsigned long first, last;
+
+	chunk_edges(s, c, &first, &last);
+	for (unsigned long i = first; i < last; i++) {
+		const os_edge_t *e = &s->edges[i];
+
+		if (skip_edge(s, e))
+			continue;
+		counts[bucket_of(s, e->src)]++;
+		counts[bucket_of(s, e->dst)]++;
+	}
+}
+
+/* Copy the edge ends of chunk 'c' to the places the counts gave it. */
+static void build_distribute(build_state_t *s, unsigned int c)
+{
+	unsigned long *cursors = &s->counts[(unsigned long) c * s->num_chunks];
+	unsigned long first, last;
+
+	chunk_edges(s, c, &first, &last);
+	for (unsigned long i = first; i < last; i++) {
+		const os_edge_t *e = &s->edges[i];
+
+		if (skip_edge(s, e))
+			continue;
+		s->ends[cursors[bucket_of(s, e->src)]++] =
+			(os_edge_t) { e->src, e->dst, e->weight };
+		s->ends[cursors[bucket_of(s, e->dst)]++] =
+			(os_edge_t) { e->dst, e->src, e->weight };
+	}
+}
+
+/*
+ * Sort the neighbour lists of a bucket and drop their duplicates,
+ * compacting them to the start of the bucket. Self-loops were never
+ * bucketed. Weights sort along, so the lowest one of duplicates is kept.
+ * Return the number of neighbours left.
+ */
+static unsigned long bucket_simplify(build_state_t *s, unsigned int first, unsigned int last,
+		unsigned long base, unsigned long end)
+{
+	unsigned long *offsets = s->graph->offsets;
+	unsigned int *neighbours = s->graph->neighbours;
+	unsigned int *weights = s->graph->weights;
+	unsigned long *keys = NULL;
+	unsigned long pos = base;
+
+	if (weights != NULL) {
+		keys = malloc((end - base) * sizeof(*keys));
+		DIE(keys == NULL && end != base, "malloc");
+	}
+
+	for (unsigned int u = first; u < last; u++) {
+		unsigned long start = offsets[u];
+		unsigned long stop = u + 1 < last ? offsets[u + 1] : end;
+
+		sort_neighbours(neighbours + start, weights != NULL ? weights + start : NULL,
+				stop - start, keys);
+
+		offsets[u] = pos;
+		for (unsigned long i = start; i < stop; i++) {
+			if (i != start && neighbours[i] == neighbours[i - 1])
+				continue;
+			if (weights != NULL)
+				weights[pos] = weights[i];
+			neighbours[pos++] = neighbours[i];
+		}
+	}
+	free(keys);
+
+	return pos - base;
+}
+
+/*
+ * Lay out the adjacency of the nodes of bucket 'b', out of its edge ends:
+ * count degrees, prefix sum them into offsets from the start of the
+ * bucket, then scatter the ends, using the offsets as cursors.
+ */
+static void build_bucket(build_state_t *s, unsigned int b)
+{
+	os_graph_t *graph = s->graph;
+	unsigned long *offsets = graph->offsets;
+	unsigned long base = s->bucket_start[b], end = s->bucket_start[b + 1];
+	unsigned long pos = base;
+	unsigned int first, last;
+
+	bucket_nodes(s, b, &first, &last);
+	if (first == last)
+		return;
+
+	memcpy(graph->values + first, s->values + first, (last - first) * sizeof(*graph->values));
+
+	for (unsigned int u = first; u < last; u++)
+		offsets[u] = 0;
+	for (unsigned long i = base; i < end; i++)
+		offsets[s->ends[i].src]++;
+
+	for (unsigned int u = first; u < last; u++) {
+		unsigned long degree = offsets[u];
+
+		offsets[u] = pos;
+		pos += degree;
+	}
+
+	for (unsigned long i = base; i < end; i++) {
+		unsigned long p = offsets[s->ends[i].src]++;
+
+		graph->neighbours[p] = s->ends[i].dst;
+		if (graph->weights != NULL)
+			graph->weights[p] = s->ends[i].weight;
+	}
+
+	/*
+	 * Each cursor now points to the start of the next list. The end of
+	 * the last one is the start of the next bucket, set by that bucket.
+	 */
+	for (unsigned int u = last - 1; u > first; u--)
+		offsets[u] = offsets[u - 1];
+	offsets[first] = base;
+
+	if (s->flags & GRAPH_BUILD_SIMPLE)
+		s->kept[b] = bucket_simplify(s, first, last, base, end);
+}
+
+/* Move the neighbours left by bucket 'b' to their final place. */
+static void build_compact(build_state_t *s, unsigned int b)
+{
+	unsigned long *offsets = s->graph->offsets;
+	unsigned long base = s->bucket_start[b];
+	unsigned int first, last;
+
+	bucket_nodes(s, b, &first, &last);
+	memcpy(s->neighbours + s->kept_start[b], s->graph->neighbours + base,
+			s->kept[b] * sizeof(*s->neighbours));
+	if (s->weights != NULL)
+		memcpy(s->weights + s->kept_start[b], s->graph->weights + base,
+				s->kept[b] * sizeof(*s->weights));
+
+	for (unsigned int u = first; u < last; u++)
+		offsets[u] = offsets[u] - base + s->kept_start[b];
+}
+
+static void build_function(void *arg, unsigned long first, unsigned long last)
+{
+	build_state_t *s = (build_state_t *) arg;
+
+	for (unsigned long i = first; i < last; i++)
+		s->kernel(s, i);
+}
+
+/* Run one step for every chunk (or bucket) on the threadpool and wait for it. */
+static void build_run(os_threadpool_t *tp, build_state_t *s, build_kernel_t kernel)
+{
+	s->kernel = kernel;
+	parallel_for(tp, 0, s->num_chunks, 1, build_function, s);
+}
+
+/*
+ * Sum up the counts bucket by bucket, chunk by chunk within a bucket, so
+ * that every count turns into the position of its first edge end.
+ * Return the number of edge ends.
+ */
+static unsigned long build_scan(build_state_t *s)
+{
+	unsigned long pos = 0;
+
+	for (unsigned int b = 0; b < s->num_chunks; b++) {
+		s->bucket_start[b] = pos;
+		for (unsigned int c = 0; c < s->num_chunks; c++) {
+			unsigned long *count = &s->counts[(unsigned long) c * s->num_chunks + b];
+			unsigned long n = *count;
+
+			*count = pos;
+			pos += n;
+		}
+	}
+	s->bucket_start[s->num_chunks] = pos;
+
+	return pos;
+}
+
+/*
+ * Build a graph like create_graph_from_data(), on the threads of 'tp'.
+ * With GRAPH_BUILD_SIMPLE, self-loops and duplicate edges are dropped;
+ * with GRAPH_BUILD_WEIGHTED, the edge weights are kept.
+ */
+os_graph_t *create_graph_from_data_parallel(os_threadpool_t *tp, unsigned int num_nodes,
+		unsigned int num_edges, int *values, os_edge_t *edges, int flags)
+{
+	os_graph_t *graph;
+	build_state_t s;
+	unsigned long num_ends;
+
+	if (num_nodes == 0)
+		return create_graph_from_data(num_nodes, num_edges, values, edges,
+				flags & GRAPH_BUILD_WEIGHTED);
+
+	graph = malloc(sizeof(*graph));
+	DIE(graph == NULL, "malloc");
+
+	graph->num_nodes = num_nodes;
+	graph->num_edges = num_edges;
+	graph->mapping = NULL;
+	graph->mapping_size = 0;
+	graph->perm = NULL;
+	graph->adj = NULL;
+	graph->adj_offsets = NULL;
+
+	s.graph = graph;
+	s.values = values;
+	s.edges = edges;
+	s.flags = flags;
+
+	s.num_chunks = tp->num_threads * GRAPH_BUILD_CHUNKS_PER_THREAD;
+	if (s.num_chunks > GRAPH_BUILD_MAX_CHUNKS)
+		s.num_chunks = GRAPH_BUILD_MAX_CHUNKS;
+	if (s.num_chunks > num_nodes)
+		s.num_chunks = num_nodes;
+	s.edges_per_chunk = num_edges / s.num_chunks + 1;
+	s.nodes_per_bucket = (num_nodes - 1) / s.num_chunks + 1;
+
+	s.counts = calloc((unsigned long) s.num_chunks * s.num_chunks, sizeof(*s.counts));
+	s.bucket_start = malloc((s.num_chunks + 1) * sizeof(*s.bucket_start));
+	s.kept = calloc(s.num_chunks, sizeof(*s.kept));
+	s.kept_start = malloc(s.num_chunks * sizeof(*s.kept_start));
+	DIE(s.counts == NULL || s.bucket_start == NULL || s.kept == NULL || s.kept_start == NULL,
+			"malloc");
+	build_run(tp, &s, build_count);
+	num_ends = build_scan(&s);
+
+	s.ends = malloc(num_ends * sizeof(*s.ends));
+	DIE(s.ends == NULL && num_ends != 0, "malloc");
+	build_run(tp, &s, build_distribute);
+
+	graph->values = malloc(num_nodes * sizeof(*graph->values));
+	graph->offsets = malloc((num_nodes + 1UL) * sizeof(*graph->offsets));
+	graph->neighbours = malloc(num_ends * sizeof(*graph->neighbours));
+	graph->weights = NULL;
+	if (flags & GRAPH_BUILD_WEIGHTED)
+		graph->weights = malloc(num_ends * sizeof(*graph->weights));
+	DIE(graph->values == NULL || graph->offsets == NULL, "malloc");
+	DIE(graph->neighbours == NULL && num_ends != 0, "malloc");
+	DIE((flags & GRAPH_BUILD_WEIGHTED) && graph->weights == NULL && num_ends != 0, "malloc");
+	build_run(tp, &s, build_bucket);
+	free(s.ends);
+
+	if (flags & GRAPH_BUILD_SIMPLE) {
+		num_ends = 0;
+		for (unsigned int b = 0; b < s.num_chunks; b++) {
+			s.kept_start[b] = num_ends;
+			num_ends += s.kept[b];
+		}
+
+		s.neighbours = malloc(num_ends * sizeof(*s.neighbours));
+		DIE(s.neighbours == NULL && num_ends != 0, "malloc");
+		s.weights = NULL;
+		if (graph->weights != NULL) {
+			s.weights = malloc(num_ends * sizeof(*s.weights));
+			DIE(s.weights == NULL && num_ends != 0, "malloc");
+		}
+		build_run(tp, &s, build_compact);
+
+		free(graph->neighbours);
+		graph->neighbours = s.neighbours;
+		if (graph->weights != NULL) {
+			free(graph->weights);
+			graph->weights = s.weights;
+		}
+		graph->num_edges = num_ends / 2;
+	}
+	graph->offsets[num_nodes] = num_ends;
+
+	graph->visited = NULL;
+
+	free(s.counts);
+	free(s.bucket_start);
+	free(s.kept);
+	free(s.kept_start);
+
+	return graph;
+}
+
+/* os_graph_builder_t building graphs with create_graph_from_data_parallel(). */
+os_graph_t *build_graph_parallel(void *ctx, unsigned int num_nodes, unsigned int num_edges,
+		int *values, os_edge_t *edges, int weighted)
+{
+	os_graph_build_ctx_t *c = (os_graph_build_ctx_t *) ctx;
+
+	return create_graph_from_data_parallel(c->tp, num_nodes, num_edges, values, edges,
+			c->flags | (weighted ? GRAPH_BUILD_WEIGHTED : 0));
+}
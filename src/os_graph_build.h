@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Parallel CSR construction, by counting sort of the edge ends.
+ *
+ * The nodes are split into ranges ("buckets") and the edges into chunks,
+ * as many of each. Every chunk counts how many of its edge ends fall into
+ * each bucket; a prefix sum over these counts gives every chunk its own
+ * place in each bucket, where it copies its edge ends in order. Each
+ * bucket then lays out the adjacency of its nodes alone, in a range of
+ * the neighbours array no other bucket writes to.
+ *
+ * As bucketing is stable, neighbours are listed in the order of the
+ * edges, so the graph is the same create_graph_from_data() builds.
+ */
+
+#ifndef __OS_GRAPH_BUILD_H__
+#define __OS_GRAPH_BUILD_H__	1
+
+#include "os_graph.h"
+#include "os_threadpool.h"
+
+/*
+ * Drop self-loops and duplicate edges. Neighbours are then sorted, and
+ * duplicates keep their lowest weight.
+ */
+#define GRAPH_BUILD_SIMPLE	(1 << 0)
+/* Keep the edge weights (set by build_graph_parallel() for weighted files). */
+#define GRAPH_BUILD_WEIGHTED	(1 << 1)
+
+/* Chunk (and bucket) count limit, as each chunk has a counter per bucket. */
+#define GRAPH_BUILD_MAX_CHUNKS	256
+
+/* Chunks per thread: a few, so that threads can balance load. */
+#define GRAPH_BUILD_CHUNKS_PER_THREAD	4
+
+/* Context of build_graph_parallel(), the builder for create_graph_from_file_with(). */
+typedef struct os_graph_build_ctx {
+	os_threadpool_t *tp;
+	int flags;
+} os_graph_build_ctx_t;
+
+os_graph_t *create_graph_from_data_parallel(os_threadpool_t *tp, unsigned int num_nodes,
+		unsigned int num_edges, int *values, os_edge_t *edges, int flags);
+os_graph_t *build_graph_parallel(void *ctx, unsigned int num_nodes, unsigned int num_edges,
+		int *values, os_edge_t *edges, int weighted);
+
+#endif
@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "os_graph_compress.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* Longest varint of a 32-bit value. */
+#define VARINT_MAX_BYTES	5
+
+/* Let the kernel reclaim the pages of a range of a (file backed) mapping. */
+static void drop_pages(void *addr, size_t len)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	unsigned long start = ((unsigned long) addr + page - 1) / page * page;
+	unsigned long end = ((unsigned long) addr + len) / page * page;
+
+	if (start < end)
+		madvise((void *) start, end - start, MADV_DONTNEED);
+}
+
+static unsigned char *put_varint(unsigned char *p, unsigned int value)
+{
+	while (value >= 0x80) {
+		*p++ = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	*p++ = value;
+
+	return p;
+}
+
+/*
+ * Replace the plain adjacency of 'graph' by the compressed one. Lists get
+ * sorted on the way, and the weights, which stay plain, along with them.
+ * The plain neighbours are freed, or, for a mapped graph, left to the
+ * kernel to page out.
+ */
+void compress_graph(os_graph_t *graph)
+{
+	unsigned int num_nodes = graph->num_nodes;
+	unsigned int max_degree = 0;
+	unsigned long capacity, len = 0;
+	unsigned long *keys = NULL; // Scratch space of sort_neighbours()
+	unsigned int *list;
+
+	if (graph->adj != NULL)
+		return;
+
+	for (unsigned int i = 0; i < num_nodes; i++)
+		if (graph_degree(graph, i) > max_degree)
+			max_degree = graph_degree(graph, i);
+
+	list = malloc((max_degree + 1UL) * sizeof(*list));
+	graph->adj_offsets = malloc((num_nodes + 1UL) * sizeof(*graph->adj_offsets));
+	DIE(list == NULL || graph->adj_offsets == NULL, "malloc");
+	if (graph->weights != NULL) {
+		keys = malloc((max_degree + 1UL) * sizeof(*keys));
+		DIE(keys == NULL, "malloc");
+	}
+
+	/* Start with about two bytes per neighbour, grow as needed. */
+	capacity = 2 * graph->offsets[num_nodes] + VARINT_MAX_BYTES;
+	graph->adj = malloc(capacity);
+	DIE(graph->adj == NULL, "malloc");
+
+	for (unsigned int i = 0; i < num_nodes; i++) {
+		unsigned int degree = graph_degree(graph, i);
+		unsigned int last = i;
+		unsigned char *p;
+
+		if (capacity - len < (unsigned long) degree * VARINT_MAX_BYTES) {
+			capacity = 2 * capacity + (unsigned long) degree * VARINT_MAX_BYTES;
+			graph->adj = realloc(graph->adj, capacity);
+			DIE(graph->adj == NULL, "realloc");
+		}
+
+		memcpy(list, graph_neighbours(graph, i), degree * sizeof(*list));
+		sort_neighbours(list,
+				graph->weights != NULL ? graph->weights + graph->offsets[i] : NULL,
+				degree, keys);
+
+		graph->adj_offsets[i] = len;
+		p = graph->adj + len;
+		for (unsigned int j = 0; j < degree; j++) {
+			unsigned int delta = list[j] - last;
+
+			/* Zigzag the first one, which may be lower than the node. */
+			if (j == 0)
+				delta = (delta << 1) ^ -(delta >> 31);
+			p = put_varint(p, delta);
+			last = list[j];
+		}
+		len = p - graph->adj;
+	}
+	graph->adj_offsets[num_nodes] = len;
+
+	graph->adj = realloc(graph->adj, len + 1);
+	DIE(graph->adj == NULL, "realloc");
+	free(keys);
+	free(list);
+
+	if (graph->mapping == NULL)
+		free(graph->neighbours);
+	else
+		drop_pages(graph->neighbours, graph->offsets[num_nodes] * sizeof(*graph->neighbours));
+	graph->neighbours = NULL;
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Compressed adjacency.
+ *
+ * Once sorted, a neighbour list is mostly made of small gaps, all the
+ * more after relabelling the nodes for locality (see os_graph_order.h).
+ * compress_graph() stores each list as varint encoded gaps (see
+ * graph_iter_decode()), usually one or two bytes per neighbour instead
+ * of four, which cuts the memory of the graph and the bytes a traversal
+ * reads per edge, at the cost of decoding them.
+ *
+ * Compressing a mapped binary graph only reads its neighbours section,
+ * whose pages the kernel may then drop, so graphs whose plain adjacency
+ * would not fit in memory can still be traversed.
+ */
+
+#ifndef __OS_GRAPH_COMPRESS_H__
+#define __OS_GRAPH_COMPRESS_H__	1
+
+#include "os_graph.h"
+
+void compress_graph(os_graph_t *graph);
+
+#endif
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "os_graph_order.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* Parse an order name: none, degree, bfs or rcm. Return -1 if unknown. */
+int parse_graph_order(const char *str, os_graph_order_t *order)
+{
+	if (strcmp(str, "none") == 0)
+		*order = GRAPH_ORDER_NONE;
+	else if (strcmp(str, "degree") == 0)
+		*order = GRAPH_ORDER_DEGREE;
+	else if (strcmp(str, "bfs") == 0)
+		*order = GRAPH_ORDER_BFS;
+	else if (strcmp(str, "rcm") == 0)
+		*order = GRAPH_ORDER_RCM;
+	else
+		return -1;
+
+	return 0;
+}
+
+static unsigned int max_degree(const os_graph_t *graph)
+{
+	unsigned int max = 0;
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		if (graph_degree(graph, i) > max)
+			max = graph_degree(graph, i);
+
+	return max;
+}
+
+/* All nodes by degree, increasing or decreasing, ties by ID: a counting sort. */
+static void sort_by_degree(const os_graph_t *graph, unsigned int *order, int decreasing)
+{
+	unsigned int max = max_degree(graph);
+	unsigned long *start;
+	unsigned long pos = 0;
+
+	start = calloc(max + 1UL, sizeof(*start));
+	DIE(start == NULL, "calloc");
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		start[graph_degree(graph, i)]++;
+
+	for (unsigned long d = 0; d <= max; d++) {
+		unsigned long k = decreasing ? max - d : d;
+		unsigned long count = start[k];
+
+		start[k] = pos;
+		pos += count;
+	}
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		order[start[graph_degree(graph, i)]++] = i;
+
+	free(start);
+}
+
+static int cmp_keys(const void *a, const void *b)
+{
+	unsigned long x = *(const unsigned long *) a, y = *(const unsigned long *) b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Breadth-first order of all nodes, using 'order' as the queue. Each
+ * component is entered from the first of 'starts' it holds (nodes by ID
+ * if NULL). With 'by_degree', the nodes found from a node are queued by
+ * increasing degree (Cuthill-McKee), otherwise in adjacency order.
+ */
+static void order_breadth_first(const os_graph_t *graph, unsigned int *order,
+		const unsigned int *starts, int by_degree)
+{
+	unsigned int num_nodes = graph->num_nodes;
+	unsigned long *keys = NULL;
+	unsigned char *seen;
+	unsigned int head = 0, tail = 0;
+
+	seen = calloc(num_nodes, sizeof(*seen));
+	DIE(seen == NULL && num_nodes != 0, "calloc");
+	if (by_degree) {
+		keys = malloc((max_degree(graph) + 1UL) * sizeof(*keys));
+		DIE(keys == NULL, "malloc");
+	}
+
+	for (unsigned int s = 0; s < num_nodes; s++) {
+		unsigned int start = starts != NULL ? starts[s] : s;
+
+		if (seen[start])
+			continue;
+		seen[start] = 1;
+		order[tail++] = start;
+
+		while (head < tail) {
+			unsigned int u = order[head++];
+			unsigned int first = tail;
+			os_neighbour_iter_t it;
+			unsigned int v;
+
+			graph_iter_init(&it, graph, u);
+			while (graph_iter_next(&it, v)) {
+				if (seen[v])
+					continue;
+				seen[v] = 1;
+				order[tail++] = v;
+			}
+
+			if (!by_degree || tail - first < 2)
+				continue;
+
+			/* Degree in the high half, node in the low one. */
+			for (unsigned int i = first; i < tail; i++)
+				keys[i - first] = (unsigned long) graph_degree(graph, order[i]) << 32 | order[i];
+			qsort(keys, tail - first, sizeof(*keys), cmp_keys);
+			for (unsigned int i = first; i < tail; i++)
+				order[i] = (unsigned int) keys[i - first];
+		}
+	}
+
+	free(keys);
+	free(seen);
+}
+
+/* Reverse Cuthill-McKee order. */
+static void order_rcm(const os_graph_t *graph, unsigned int *order)
+{
+	unsigned int num_nodes = graph->num_nodes;
+	unsigned int *starts;
+
+	starts = malloc(num_nodes * sizeof(*starts));
+	DIE(starts == NULL && num_nodes != 0, "malloc");
+
+	sort_by_degree(graph, starts, 0);
+	order_breadth_first(graph, order, starts, 1);
+
+	for (unsigned int i = 0; i < num_nodes / 2; i++) {
+		unsigned int tmp = order[i];
+
+		order[i] = order[num_nodes - 1 - i];
+		order[num_nodes - 1 - i] = tmp;
+	}
+
+	free(starts);
+}
+
+/*
+ * Relabel the nodes of 'graph' in the given order, into a new graph with
+ * sorted neighbour lists (and their weights along). 'perm' maps its nodes
+ * to the input IDs, through the permutation 'graph' may already have.
+ * 'graph' is left untouched.
+ */
+os_graph_t *reorder_graph(const os_graph_t *graph, os_graph_order_t order)
+{
+	unsigned int num_nodes = graph->num_nodes;
+	unsigned int *old; // Node of 'graph' that each new node was
+	unsigned int *rank; // New node of each node of 'graph'
+	unsigned long *keys = NULL; // Scratch space of sort_neighbours()
+	unsigned long pos = 0;
+	os_graph_t *g;
+
+	old = malloc(num_nodes * sizeof(*old));
+	rank = malloc(num_nodes * sizeof(*rank));
+	DIE(num_nodes != 0 && (old == NULL || rank == NULL), "malloc");
+
+	switch (order) {
+	case GRAPH_ORDER_DEGREE:
+		sort_by_degree(graph, old, 1);
+		break;
+	case GRAPH_ORDER_BFS:
+		order_breadth_first(graph, old, NULL, 0);
+		break;
+	case GRAPH_ORDER_RCM:
+		order_rcm(graph, old);
+		break;
+	default:
+		for (unsigned int i = 0; i < num_nodes; i++)
+			old[i] = i;
+	}
+
+	for (unsigned int i = 0; i < num_nodes; i++)
+		rank[old[i]] = i;
+
+	g = malloc(sizeof(*g));
+	DIE(g == NULL, "malloc");
+
+	g->num_nodes = num_nodes;
+	g->num_edges = graph->num_edges;
+	g->mapping = NULL;
+	g->mapping_size = 0;
+	g->adj = NULL;
+	g->adj_offsets = NULL;
+	g->offsets = malloc((num_nodes + 1UL) * sizeof(*g->offsets));
+	g->neighbours = malloc(graph->offsets[num_nodes] * sizeof(*g->neighbours));
+	g->values = malloc(num_nodes * sizeof(*g->values));
+	g->perm = malloc(num_nodes * sizeof(*g->perm));
+	DIE(g->offsets == NULL || (g->neighbours == NULL && graph->offsets[num_nodes] != 0), "malloc");
+	DIE(num_nodes != 0 && (g->values == NULL || g->perm == NULL), "malloc");
+	g->weights = NULL;
+	if (graph->weights != NULL) {
+		g->weights = malloc(graph->offsets[num_nodes] * sizeof(*g->weights));
+		keys = malloc((max_degree(graph) + 1UL) * sizeof(*keys));
+		DIE(keys == NULL || (g->weights == NULL && graph->offsets[num_nodes] != 0), "malloc");
+	}
+
+	for (unsigned int i = 0; i < num_nodes; i++) {
+		unsigned int u = old[i];
+		unsigned int degree = graph_degree(graph, u);
+		os_neighbour_iter_t it;
+		unsigned int v;
+
+		g->offsets[i] = pos;
+		graph_iter_init(&it, graph, u);
+		for (unsigned int j = 0; graph_iter_next(&it, v); j++) {
+			g->neighbours[pos + j] = rank[v];
+			if (g->weights != NULL)
+				g->weights[pos + j] = graph->weights[graph->offsets[u] + j];
+		}
+		sort_neighbours(g->neighbours + pos, g->weights != NULL ? g->weights + pos : NULL,
+				degree, keys);
+		pos += degree;
+
+		g->values[i] = graph->values[u];
+		g->perm[i] = graph->perm != NULL ? graph->perm[u] : u;
+	}
+	g->offsets[num_nodes] = pos;
+
+	g->visited = NULL;
+
+	free(keys);
+	free(old);
+	free(rank);
+
+	return g;
+}
+
+/*
+ * Node of 'graph' with input ID 'id', found by a scan of 'perm' for
+ * relabelled graphs. Return 'id' itself if there is no such node.
+ */
+unsigned int graph_node_from_input(const os_graph_t *graph, unsigned int id)
+{
+	if (graph->perm == NULL)
+		return id;
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		if (graph->perm[i] == id)
+			return i;
+
+	return id;
+}
+
+/*
+ * Turn the components of a relabelled graph into the components of the
+ * input graph: indexed by input ID and labeled with the smallest input ID
+ * of each. 'cc' is consumed. Graphs with input IDs get 'cc' back.
+ */
+os_components_t *components_to_input(const os_graph_t *graph, os_components_t *cc)
+{
+	unsigned int num_nodes = cc->num_nodes;
+	unsigned int *smallest; // Smallest input ID of each component, by label
+	os_components_t *out;
+
+	if (graph->perm == NULL)
+		return cc;
+
+	smallest = malloc(num_nodes * sizeof(*smallest));
+	DIE(smallest == NULL && num_nodes != 0, "malloc");
+	for (unsigned int i = 0; i < num_nodes; i++)
+		smallest[i] = UINT_MAX;
+	for (unsigned int i = 0; i < num_nodes; i++)
+		if (graph->perm[i] < smallest[cc->label[i]])
+			smallest[cc->label[i]] = graph->perm[i];
+
+	out = create_components(num_nodes);
+	out->count = cc->count;
+	for (unsigned int i = 0; i < num_nodes; i++) {
+		out->size[i] = 0;
+		out->sum[i] = 0;
+	}
+	for (unsigned int i = 0; i < num_nodes; i++) {
+		out->label[graph->perm[i]] = smallest[cc->label[i]];
+		if (cc->label[i] == i) {
+			out->size[smallest[i]] = cc->size[i];
+			out->sum[smallest[i]] = cc->sum[i];
+		}
+	}
+
+	free(smallest);
+	destroy_components(cc);
+
+	return out;
+}
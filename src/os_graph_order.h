@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Vertex reordering, for locality.
+ *
+ * Input node IDs are arbitrary, so following the neighbours of a node
+ * reads 'values' and 'visited' all over memory. Relabelling the nodes so
+ * that neighbours get close IDs turns most of these reads into cache
+ * hits:
+ *
+ * - GRAPH_ORDER_DEGREE: by decreasing degree, hubs first and together;
+ * - GRAPH_ORDER_BFS: in breadth-first order, from node 0, then from the
+ *   lowest node left in every other component;
+ * - GRAPH_ORDER_RCM: reverse Cuthill-McKee, breadth-first from a node of
+ *   lowest degree in each component, visiting neighbours by increasing
+ *   degree, then reversed. It keeps the IDs of neighbours the closest.
+ *
+ * The relabelled graph keeps the input ID of each node in 'perm', which
+ * binary files store, so the cost is paid once, by graph_convert -o.
+ * Results are reported in input IDs all the same.
+ */
+
+#ifndef __OS_GRAPH_ORDER_H__
+#define __OS_GRAPH_ORDER_H__	1
+
+#include "os_graph.h"
+
+typedef enum {
+	GRAPH_ORDER_NONE,
+	GRAPH_ORDER_DEGREE,
+	GRAPH_ORDER_BFS,
+	GRAPH_ORDER_RCM
+} os_graph_order_t;
+
+int parse_graph_order(const char *str, os_graph_order_t *order);
+os_graph_t *reorder_graph(const os_graph_t *graph, os_graph_order_t order);
+
+unsigned int graph_node_from_input(const os_graph_t *graph, unsigned int id);
+os_components_t *components_to_input(const os_graph_t *graph, os_components_t *cc);
+
+#endif
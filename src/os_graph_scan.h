@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Scanner of the text graph format, shared by the parser of whole files
+ * (os_graph.c) and the streaming one (os_graph_stream.c).
+ */
+
+#ifndef __OS_GRAPH_SCAN_H__
+#define __OS_GRAPH_SCAN_H__	1
+
+/*
+ * Cursor over the text representation of a graph.
+ * 'line' is only maintained for error reporting.
+ */
+typedef struct {
+	const char *pos;
+	const char *end;
+	unsigned int line;
+} graph_scanner_t;
+
+enum {
+	SCAN_OK = 0,
+	SCAN_EOF = 1,
+	SCAN_BAD = 2
+};
+
+/* Longest decimal number accepted; keeps the accumulator from overflowing. */
+#define SCAN_MAX_DIGITS		18
+
+int scan_number(graph_scanner_t *s, long long *val);
+int scan_more_on_line(const graph_scanner_t *s);
+int scan_ranged(graph_scanner_t *s, long long min, long long max,
+		long long *val, const char *what);
+
+#endif
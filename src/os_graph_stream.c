@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "os_graph_stream.h"
+#include "os_graph_scan.h"
+#include "os_graph_update.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* A read of the next chunk, run as a task. */
+typedef struct {
+	FILE *file;
+	char *buf;
+	size_t size; // Bytes to read
+	size_t len; // Bytes read, short at the end of the file
+	int error; // The read failed, with 'errno' then in 'err'
+	int err; // errno is per thread, and the read runs on a worker
+} stream_read_t;
+
+/* Where the parsing is at, from one chunk to the next. */
+typedef struct {
+	enum {
+		STREAM_NUM_NODES,
+		STREAM_NUM_EDGES,
+		STREAM_VALUES,
+		STREAM_EDGES,
+		STREAM_DONE
+	} step;
+	unsigned int num_edges;
+	unsigned int next; // Next value or edge to parse
+	unsigned int field; // Numbers of the current edge parsed so far
+	long long edge[3]; // Source, destination and weight (ignored)
+	int weighted; // Edges have a weight, as the first one tells
+	unsigned int line; // Line the next chunk starts on
+	os_components_t *cc; // Allocated once the number of nodes is known
+} stream_parser_t;
+
+static void stream_read(void *arg)
+{
+	stream_read_t *r = (stream_read_t *) arg;
+
+	errno = 0;
+	r->len = fread(r->buf, 1, r->size, r->file);
+	r->error = ferror(r->file);
+	r->err = errno;
+}
+
+/*
+ * Length of the part of a chunk that can be parsed on its own: up to its
+ * last newline, or, within a line longer than the chunk (the values),
+ * up to its last blank. 0 if it has neither.
+ */
+static size_t chunk_cut(const char *buf, size_t len)
+{
+	const char *nl = memrchr(buf, '\n', len);
+
+	if (nl != NULL)
+		return nl - buf + 1;
+
+	while (len > 0 && buf[len - 1] != ' ' && buf[len - 1] != '\t' && buf[len - 1] != '\r')
+		len--;
+
+	return len;
+}
+
+/* Name of the next number, for error messages. */
+static const char *stream_expected(const stream_parser_t *p)
+{
+	static const char *const edge_fields[] = {
+		"edge source", "edge destination", "edge weight"
+	};
+
+	switch (p->step) {
+	case STREAM_NUM_NODES:
+		return "number of nodes";
+	case STREAM_NUM_EDGES:
+		return "number of edges";
+	case STREAM_VALUES:
+		return "node value";
+	case STREAM_EDGES:
+		return edge_fields[p->field];
+	default:
+		return "end of file";
+	}
+}
+
+/* Move on to the edges once all values are in, and past them once all edges are. */
+static void stream_advance(stream_parser_t *p)
+{
+	if (p->step == STREAM_VALUES && p->next == p->cc->num_nodes) {
+		p->step = STREAM_EDGES;
+		p->next = 0;
+	}
+	if (p->step == STREAM_EDGES && p->next == p->num_edges)
+		p->step = STREAM_DONE;
+}
+
+/*
+ * Parse the numbers of a chunk, linking the ends of every edge. Return
+ * -1 (after logging the reason) on malformed input, 1 once the last edge
+ * is in, 0 if more chunks are needed.
+ */
+static int stream_parse(stream_parser_t *p, const char *buf, size_t len)
+{
+	graph_scanner_t s = { .pos = buf, .end = buf + len, .line = p->line };
+	long long val, min, max;
+	int rc;
+
+	while (p->step != STREAM_DONE) {
+		rc = scan_number(&s, &val);
+		if (rc == SCAN_EOF)
+			break;
+		if (rc == SCAN_BAD) {
+			log_error("line %u: malformed %s", s.line, stream_expected(p));
+			return -1;
+		}
+
+		min = p->step == STREAM_VALUES ? INT_MIN : 0;
+		max = p->step == STREAM_VALUES ? INT_MAX : UINT_MAX;
+		if (p->step == STREAM_EDGES && p->field < 2)
+			max = (long long) p->cc->num_nodes - 1;
+		if (val < min || val > max) {
+			log_error("line %u: %s %lld out of range [%lld, %lld]",
+					s.line, stream_expected(p), val, min, max);
+			return -1;
+		}
+
+		switch (p->step) {
+		case STREAM_NUM_NODES:
+			p->cc = create_components(val);
+			p->cc->count = val;
+			p->step = STREAM_NUM_EDGES;
+			break;
+		case STREAM_NUM_EDGES:
+			p->num_edges = val;
+			p->step = STREAM_VALUES;
+			break;
+		case STREAM_VALUES:
+			p->cc->label[p->next] = p->next;
+			p->cc->size[p->next] = 1;
+			p->cc->sum[p->next] = val;
+			p->next++;
+			break;
+		default:
+			p->edge[p->field++] = val;
+			if (p->field == 2 && p->next == 0)
+				p->weighted = scan_more_on_line(&s);
+			if (p->field < 2 + (unsigned int) p->weighted)
+				break;
+			components_link(p->cc, p->edge[0], p->edge[1]);
+			p->field = 0;
+			p->next++;
+		}
+		stream_advance(p);
+	}
+	p->line = s.line;
+
+	if (p->step != STREAM_DONE)
+		return 0;
+	if (scan_number(&s, &val) != SCAN_EOF)
+		log_warn("line %u: ignoring data after the last edge", s.line);
+
+	return 1;
+}
+
+/*
+ * Components of the text graph in 'file', from its current position on,
+ * read in chunks of 'chunk_size' bytes (0 for STREAM_CHUNK_SIZE), on the
+ * threads of 'tp'. Return NULL (after logging the reason) on malformed
+ * input.
+ */
+os_components_t *stream_components(os_threadpool_t *tp, FILE *file, size_t chunk_size)
+{
+	stream_parser_t p = { .step = STREAM_NUM_NODES, .line = 1 };
+	stream_read_t r = { .file = file };
+	size_t len, cut, carry = 0;
+	char *bufs[2];
+	unsigned int cur = 0;
+	int eof, rc;
+	os_job_t job;
+
+	if (chunk_size == 0)
+		chunk_size = STREAM_CHUNK_SIZE;
+	if (chunk_size < STREAM_MIN_CHUNK_SIZE)
+		chunk_size = STREAM_MIN_CHUNK_SIZE;
+
+	/* What is carried over is shorter than a chunk: room for both. */
+	bufs[0] = malloc(2 * chunk_size);
+	bufs[1] = malloc(2 * chunk_size);
+	DIE(bufs[0] == NULL || bufs[1] == NULL, "malloc");
+	posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+	job_init(&job);
+
+	r.buf = bufs[0];
+	r.size = chunk_size;
+	stream_read(&r);
+	len = r.len;
+
+	while (1) {
+		if (r.error) {
+			log_error("Can't read the graph: %s", strerror(r.err));
+			rc = -1;
+			break;
+		}
+
+		eof = r.len < r.size;
+		cut = eof ? len : chunk_cut(bufs[cur], len);
+		if (cut == 0 && !eof) {
+			log_error("line %u: number longer than a chunk", p.line);
+			rc = -1;
+			break;
+		}
+
+		/* Read the next chunk, after what this one carries over, meanwhile. */
+		if (!eof) {
+			carry = len - cut;
+			memcpy(bufs[!cur], bufs[cur] + cut, carry);
+			r.buf = bufs[!cur] + carry;
+			enqueue_job_task(tp, &job, create_task(stream_read, &r, NULL));
+		}
+
+		rc = stream_parse(&p, bufs[cur], cut);
+
+		if (!eof)
+			wait_for_job(tp, &job);
+		if (rc != 0 || eof)
+			break;
+
+		len = carry + r.len;
+		cur = !cur;
+	}
+
+	if (rc == 0 && p.step != STREAM_DONE) {
+		log_error("line %u: unexpected end of file, expected %s", p.line, stream_expected(&p));
+		rc = -1;
+	}
+
+	job_destroy(&job);
+	free(bufs[0]);
+	free(bufs[1]);
+
+	if (rc < 0) {
+		destroy_components(p.cc);
+		return NULL;
+	}
+
+	/* Every node points to a smaller one, whose label is final by then. */
+	for (unsigned int i = 0; i < p.cc->num_nodes; i++)
+		p.cc->label[i] = p.cc->label[p.cc->label[i]];
+
+	return p.cc;
+}
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Streaming of text graphs larger than memory: the components of the
+ * graph, and so the sum reachable from any node, out of a single pass
+ * over the file, without building the graph.
+ *
+ * Only per-node state is kept, the union-find forest of os_components_t
+ * (see os_graph_update.h): a node's value goes into the sum of its
+ * component as it is read, and every edge links its ends as it is read.
+ * The file is read in chunks of a fixed size, cut after their last full
+ * line, the rest carried over to the next chunk. Two buffers take turns:
+ * a task of the threadpool reads the next chunk into one while the
+ * caller parses the other, so that reading overlaps with parsing.
+ *
+ * Binary graphs are not streamed: they are mapped and paged in on
+ * demand anyway.
+ */
+
+#ifndef __OS_GRAPH_STREAM_H__
+#define __OS_GRAPH_STREAM_H__	1
+
+#include <stdio.h>
+
+#include "os_graph.h"
+#include "os_threadpool.h"
+
+/* Bytes read at a time, by default and at least. */
+#define STREAM_CHUNK_SIZE	(8UL << 20)
+#define STREAM_MIN_CHUNK_SIZE	4096UL
+
+os_components_t *stream_components(os_threadpool_t *tp, FILE *file, size_t chunk_size);
+
+#endif
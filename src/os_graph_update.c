@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+
+#include "os_graph_update.h"
+#include "log/log.h"
+#include "utils.h"
+
+/*
+ * Open 'graph' to updates, with its components 'cc', by input ID (see
+ * components_to_input()). 'cc' is consumed; 'graph' stays the caller's.
+ */
+os_dynamic_graph_t *create_dynamic_graph(os_graph_t *graph, os_components_t *cc)
+{
+	os_dynamic_graph_t *dg;
+
+	dg = malloc(sizeof(*dg));
+	DIE(dg == NULL, "malloc");
+
+	dg->graph = graph;
+	dg->cc = cc;
+	dg->node_of = NULL;
+
+	/* Value changes come by input ID, and must not scan 'perm' for the node. */
+	if (graph->perm != NULL) {
+		dg->node_of = malloc(graph->num_nodes * sizeof(*dg->node_of));
+		DIE(dg->node_of == NULL && graph->num_nodes != 0, "malloc");
+		for (unsigned int i = 0; i < graph->num_nodes; i++)
+			dg->node_of[graph->perm[i]] = i;
+	}
+
+	return dg;
+}
+
+void destroy_dynamic_graph(os_dynamic_graph_t *dg)
+{
+	destroy_components(dg->cc);
+	free(dg->node_of);
+	free(dg);
+}
+
+/* Root of the component of node 'id' in the forest 'cc', halving the path to it. */
+unsigned int components_find(os_components_t *cc, unsigned int id)
+{
+	unsigned int *label = cc->label;
+
+	while (label[id] != id) {
+		label[id] = label[label[id]];
+		id = label[id];
+	}
+
+	return id;
+}
+
+/*
+ * Join the components of 'a' and 'b' in the forest 'cc', under the
+ * smaller root, so that every root stays the smallest node of its
+ * component, and every node points to a smaller one.
+ */
+void components_link(os_components_t *cc, unsigned int a, unsigned int b)
+{
+	unsigned int tmp;
+
+	a = components_find(cc, a);
+	b = components_find(cc, b);
+	if (a == b)
+		return;
+	if (b < a) {
+		tmp = a;
+		a = b;
+		b = tmp;
+	}
+
+	cc->label[b] = a;
+	cc->size[a] += cc->size[b];
+	cc->sum[a] += cc->sum[b];
+	cc->count--;
+}
+
+/* Root of the component of input ID 'id'. */
+unsigned int dynamic_component(os_dynamic_graph_t *dg, unsigned int id)
+{
+	return components_find(dg->cc, id);
+}
+
+/* Sum of the values reachable from input ID 'id'; 0 if there is no such node. */
+long long dynamic_sum(os_dynamic_graph_t *dg, unsigned int id)
+{
+	if (id >= dg->cc->num_nodes)
+		return 0;
+
+	return dg->cc->sum[dynamic_component(dg, id)];
+}
+
+/*
+ * Apply the updates of 'batch', in order. Return -1, leaving everything
+ * as it was, if one of them names a node the graph does not have.
+ */
+int apply_updates(os_dynamic_graph_t *dg, const os_update_batch_t *batch)
+{
+	unsigned int num_nodes = dg->graph->num_nodes;
+
+	for (unsigned int i = 0; i < batch->count; i++) {
+		const os_update_t *u = &batch->updates[i];
+
+		if (u->node >= num_nodes || (u->type == GRAPH_UPDATE_EDGE && u->dst >= num_nodes)) {
+			log_error("Update %u of the batch names node %u, out of %u", i,
+					u->node >= num_nodes ? u->node : u->dst, num_nodes);
+			return -1;
+		}
+	}
+
+	for (unsigned int i = 0; i < batch->count; i++) {
+		const os_update_t *u = &batch->updates[i];
+		unsigned int node;
+
+		if (u->type == GRAPH_UPDATE_EDGE) {
+			components_link(dg->cc, u->node, u->dst);
+			continue;
+		}
+
+		node = dg->node_of != NULL ? dg->node_of[u->node] : u->node;
+		dg->cc->sum[dynamic_component(dg, u->node)] +=
+			(long long) u->value - dg->graph->values[node];
+		dg->graph->values[node] = u->value;
+	}
+
+	return 0;
+}
+
+/*
+ * Read the next batch of updates from 'file' into 'batch', whose array
+ * grows as needed (the caller frees it). Return 1 on success, 0 at the
+ * end of the file, and -1 if the batch is malformed.
+ */
+int read_update_batch(FILE *file, os_update_batch_t *batch)
+{
+	unsigned int count;
+	int rc;
+
+	rc = fscanf(file, "%u", &count);
+	if (rc == EOF)
+		return 0;
+	if (rc != 1)
+		return -1;
+
+	if (count > batch->capacity) {
+		batch->updates = realloc(batch->updates, count * sizeof(*batch->updates));
+		DIE(batch->updates == NULL, "realloc");
+		batch->capacity = count;
+	}
+
+	for (batch->count = 0; batch->count < count; batch->count++) {
+		os_update_t *u = &batch->updates[batch->count];
+		char type;
+
+		if (fscanf(file, " %c", &type) != 1)
+			return -1;
+
+		if (type == 'e') {
+			u->type = GRAPH_UPDATE_EDGE;
+			rc = fscanf(file, "%u %u", &u->node, &u->dst);
+		} else if (type == 'v') {
+			u->type = GRAPH_UPDATE_VALUE;
+			rc = fscanf(file, "%u %d", &u->node, &u->value);
+		} else {
+			return -1;
+		}
+		if (rc != 2)
+			return -1;
+	}
+
+	return 1;
+}
+
+/*
+ * Apply the batches of 'file' one after the other. With 'print_sums',
+ * print the sum reachable from input node 0 first, then after each batch,
+ * one per line; otherwise print the components after the last batch.
+ * Return -1 at the first malformed or invalid batch.
+ */
+int replay_updates(os_dynamic_graph_t *dg, FILE *file, int print_sums)
+{
+	os_update_batch_t batch = { .updates = NULL, .count = 0, .capacity = 0 };
+	unsigned int num_batches = 0;
+	int rc;
+
+	if (print_sums)
+		printf("%lld", dynamic_sum(dg, 0));
+
+	while ((rc = read_update_batch(file, &batch)) > 0) {
+		if (apply_updates(dg, &batch) < 0) {
+			rc = -1;
+			break;
+		}
+		if (print_sums)
+			printf("\n%lld", dynamic_sum(dg, 0));
+		num_batches++;
+	}
+	free(batch.updates);
+
+	if (rc < 0) {
+		log_error("Invalid batch of updates, after %u good ones", num_batches);
+		return -1;
+	}
+	if (!print_sums)
+		print_components(dg->cc);
+
+	return 0;
+}
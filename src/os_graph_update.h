@@ -0,0 +1,68 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Incremental updates: batches of edge insertions and node value changes
+ * applied to a loaded graph, keeping its components, and so the sum of
+ * the nodes reachable from any node, up to date without traversing it
+ * again.
+ *
+ * The components are computed once, then kept as a union-find forest:
+ * 'label' of os_components_t points towards the root of each component,
+ * its smallest node, which holds the size and the sum. An edge insertion
+ * links the roots of its ends, adding up their sizes and sums, and a
+ * value change adds its difference to the sum of its root. A batch thus
+ * costs about its own size, whatever the size of the graph.
+ *
+ * Values are changed in the graph as well. Inserted edges only join
+ * components: the adjacency is left as it was loaded, so traversals of
+ * the graph do not follow them.
+ *
+ * Update files hold batches one after the other, each as the number of
+ * updates in it, then one update per line, by input IDs:
+ *
+ *	e <src> <dst>	insert an edge
+ *	v <node> <value>	change the value of a node
+ */
+
+#ifndef __OS_GRAPH_UPDATE_H__
+#define __OS_GRAPH_UPDATE_H__	1
+
+#include <stdio.h>
+
+#include "os_graph.h"
+
+typedef struct os_update {
+	enum {
+		GRAPH_UPDATE_EDGE,
+		GRAPH_UPDATE_VALUE
+	} type;
+	unsigned int node; // Edge: source; value: the node changed
+	unsigned int dst; // Edge: destination
+	int value; // Value: the new value
+} os_update_t;
+
+typedef struct os_update_batch {
+	os_update_t *updates;
+	unsigned int count;
+	unsigned int capacity; // Updates there is room for
+} os_update_batch_t;
+
+/* A graph open to updates, and its components. */
+typedef struct os_dynamic_graph {
+	os_graph_t *graph;
+	os_components_t *cc; // By input ID, 'label' as a union-find forest
+	unsigned int *node_of; // Node of each input ID, NULL if the same
+} os_dynamic_graph_t;
+
+unsigned int components_find(os_components_t *cc, unsigned int id);
+void components_link(os_components_t *cc, unsigned int a, unsigned int b);
+
+os_dynamic_graph_t *create_dynamic_graph(os_graph_t *graph, os_components_t *cc);
+void destroy_dynamic_graph(os_dynamic_graph_t *dg);
+int apply_updates(os_dynamic_graph_t *dg, const os_update_batch_t *batch);
+unsigned int dynamic_component(os_dynamic_graph_t *dg, unsigned int id);
+long long dynamic_sum(os_dynamic_graph_t *dg, unsigned int id);
+int read_update_batch(FILE *file, os_update_batch_t *batch);
+int replay_updates(os_dynamic_graph_t *dg, FILE *file, int print_sums);
+
+#endif
@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "os_pagerank.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* Largest rank change of the ranges one thread ran, on its own cache line. */
+typedef struct {
+	double change;
+	unsigned int num_dangling; // Nodes without edges, while setting up
+} __attribute__((aligned(OS_CACHELINE_SIZE))) pagerank_local_t;
+
+typedef struct {
+	os_threadpool_t *tp;
+	os_graph_t *graph;
+	unsigned int *bounds; // First node of each range, then 'num_nodes'
+	double base; // Rank every node gets this iteration, edges apart
+
+	double *rank;
+	double *inv_degree; // 0 for the nodes without edges
+	double *contrib; // Rank over degree, of the previous iteration
+	double *next_contrib; // Neighbour sums at first, then rank over degree
+
+	pagerank_local_t *locals; // One per threadpool_worker_id()
+} pagerank_state_t;
+
+/* First node from which the adjacency and the nodes cost 'cost' or more. */
+static unsigned int range_bound(const os_graph_t *graph, unsigned long cost)
+{
+	unsigned int low = 0, high = graph->num_nodes;
+
+	while (low < high) {
+		unsigned int mid = low + (high - low) / 2;
+
+		if (graph->offsets[mid] + mid < cost)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
+/* Set up the nodes of ranges [first, last), with the ranks all equal. */
+static void pagerank_init(void *arg, unsigned long first, unsigned long last)
+{
+	pagerank_state_t *s = (pagerank_state_t *) arg;
+	pagerank_local_t *local = &s->locals[threadpool_worker_id(s->tp)];
+	double initial = 1.0 / s->graph->num_nodes;
+
+	for (unsigned int v = s->bounds[first]; v < s->bounds[last]; v++) {
+		unsigned int degree = graph_degree(s->graph, v);
+
+		s->inv_degree[v] = degree != 0 ? 1.0 / degree : 0;
+		s->rank[v] = initial;
+		s->contrib[v] = initial * s->inv_degree[v];
+		local->num_dangling += degree == 0;
+	}
+}
+
+/*
+ * Sum of the contributions of 'degree' plain neighbours. Four sums, so
+ * that the loads of the next neighbours need not wait for the additions.
+ */
+static inline double pull_plain(const unsigned int *restrict neighbours, unsigned int degree,
+		const double *restrict contrib)
+{
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	unsigned int j = 0;
+
+	for (; j + 4 <= degree; j += 4) {
+		s0 += contrib[neighbours[j]];
+		s1 += contrib[neighbours[j + 1]];
+		s2 += contrib[neighbours[j + 2]];
+		s3 += contrib[neighbours[j + 3]];
+	}
+	for (; j < degree; j++)
+		s0 += contrib[neighbours[j]];
+
+	return (s0 + s1) + (s2 + s3);
+}
+
+/* Run an iteration over the nodes of ranges [first, last). */
+static void pagerank_pull(void *arg, unsigned long first, unsigned long last)
+{
+	pagerank_state_t *s = (pagerank_state_t *) arg;
+	pagerank_local_t *local = &s->locals[threadpool_worker_id(s->tp)];
+	const os_graph_t *graph = s->graph;
+	const double *restrict contrib = s->contrib;
+	const double *restrict inv_degree = s->inv_degree;
+	double *restrict rank = s->rank;
+	double *restrict next = s->next_contrib;
+	unsigned int lo = s->bounds[first], hi = s->bounds[last];
+	double base = s->base;
+	double change = local->change;
+
+	for (unsigned int v = lo; v < hi; v++) {
+		os_neighbour_iter_t it;
+		unsigned int u;
+		double sum = 0;
+
+		if (graph->adj == NULL) {
+			next[v] = pull_plain(graph_neighbours(graph, v), graph_degree(graph, v),
+					contrib);
+			continue;
+		}
+
+		graph_iter_init(&it, graph, v);
+		while (graph_iter_next(&it, u))
+			sum += contrib[u];
+		next[v] = sum;
+	}
+
+	/*
+	 * Vectorized: the compiler only splits the maximum over lanes when
+	 * told it may (-fopenmp-simd), though any order gives the same one.
+	 */
+#pragma omp simd reduction(max:change)
+	for (unsigned int v = lo; v < hi; v++) {
+		double r = base + GRAPH_PAGERANK_DAMPING * next[v];
+		double d = r > rank[v] ? r - rank[v] : rank[v] - r;
+
+		change = d > change ? d : change;
+		rank[v] = r;
+		next[v] = r * inv_degree[v];
+	}
+
+	local->change = change;
+}
+
+/*
+ * Rank the nodes of 'graph' on the threads of 'tp', for up to
+ * 'max_iterations' iterations (0 for GRAPH_PAGERANK_ITERATIONS), or until
+ * the ranks converge. The caller frees the returned array.
+ */
+double *pagerank(os_threadpool_t *tp, os_graph_t *graph, unsigned int max_iterations)
+{
+	unsigned int num_nodes = graph->num_nodes;
+	unsigned int num_locals = tp->num_threads + 1;
+	unsigned int num_ranges = tp->num_threads * PAGERANK_RANGES_PER_THREAD;
+	unsigned long total_cost = graph->offsets[num_nodes] + num_nodes;
+	unsigned int num_dangling = 0;
+	double dangling_rank, *swap;
+	pagerank_state_t s;
+
+	if (max_iterations == 0)
+		max_iterations = GRAPH_PAGERANK_ITERATIONS;
+	if (num_ranges > num_nodes)
+		num_ranges = num_nodes;
+
+	s.tp = tp;
+	s.graph = graph;
+	s.rank = malloc(num_nodes * sizeof(*s.rank));
+	s.inv_degree = malloc(num_nodes * sizeof(*s.inv_degree));
+	s.contrib = malloc(num_nodes * sizeof(*s.contrib));
+	s.next_contrib = malloc(num_nodes * sizeof(*s.next_contrib));
+	DIE((s.rank == NULL || s.inv_degree == NULL || s.contrib == NULL ||
+			s.next_contrib == NULL) && num_nodes != 0, "malloc");
+	s.bounds = malloc((num_ranges + 1) * sizeof(*s.bounds));
+	s.locals = aligned_alloc(OS_CACHELINE_SIZE, num_locals * sizeof(*s.locals));
+	DIE(s.bounds == NULL || s.locals == NULL, "malloc");
+	memset(s.locals, 0, num_locals * sizeof(*s.locals));
+
+	for (unsigned int r = 0; r < num_ranges; r++)
+		s.bounds[r] = range_bound(graph, total_cost / num_ranges * r);
+	s.bounds[num_ranges] = num_nodes;
+
+	parallel_for(tp, 0, num_ranges, 1, pagerank_init, &s);
+	for (unsigned int t = 0; t < num_locals; t++)
+		num_dangling += s.locals[t].num_dangling;
+	dangling_rank = 1.0 / num_nodes;
+
+	for (unsigned int i = 0; i < max_iterations && num_nodes != 0; i++) {
+		double change = 0;
+
+		/*
+		 * The nodes without edges all have the same rank, so their
+		 * total needs no sum, and comes out the same on any threads.
+		 */
+		s.base = (1 - GRAPH_PAGERANK_DAMPING) / num_nodes +
+			GRAPH_PAGERANK_DAMPING * num_dangling * dangling_rank / num_nodes;
+		for (unsigned int t = 0; t < num_locals; t++)
+			s.locals[t].change = 0;
+
+		parallel_for(tp, 0, num_ranges, 1, pagerank_pull, &s);
+
+		swap = s.contrib;
+		s.contrib = s.next_contrib;
+		s.next_contrib = swap;
+		dangling_rank = s.base;
+
+		for (unsigned int t = 0; t < num_locals; t++)
+			if (s.locals[t].change > change)
+				change = s.locals[t].change;
+		if (change < GRAPH_PAGERANK_EPSILON / num_nodes)
+			break;
+	}
+
+	free(s.inv_degree);
+	free(s.contrib);
+	free(s.next_contrib);
+	free(s.bounds);
+	free(s.locals);
+
+	return s.rank;
+}
@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Parallel PageRank, pulling: every iteration, each node sums the
+ * contributions (rank over degree) of its neighbours from the previous
+ * one, which it can do without synchronizing, as every edge is stored at
+ * both ends. The rank of the nodes without edges goes to all nodes.
+ *
+ * The work of an iteration is that of the edges, so the nodes are split
+ * into ranges of about the same number of edges rather than of nodes,
+ * for parallel_for() to hand out. Within a range, the neighbour sums are
+ * gathered in one loop, a gather rather than a SIMD loop, where four sums
+ * in flight hide the latency of the scattered loads. The ranks are then
+ * updated from them in a second loop, over contiguous arrays, which the
+ * compiler vectorizes at -O3: its maximum is marked as an OpenMP SIMD
+ * reduction, for -fopenmp-simd.
+ */
+
+#ifndef __OS_PAGERANK_H__
+#define __OS_PAGERANK_H__	1
+
+#include "os_graph.h"
+#include "os_threadpool.h"
+
+/* Node ranges per thread, of about the same number of edges each. */
+#define PAGERANK_RANGES_PER_THREAD	OS_PARALLEL_FOR_CHUNKS_PER_THREAD
+
+double *pagerank(os_threadpool_t *tp, os_graph_t *graph, unsigned int max_iterations);
+
+#endif
@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "os_sssp.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* Initial number of nodes a bucket has room for. */
+#define SSSP_BIN_INITIAL_SIZE	64
+
+/* Nodes filed into a bucket by one thread. */
+typedef struct {
+	unsigned int *nodes;
+	unsigned long count;
+	unsigned long size;
+} sssp_bin_t;
+
+/* Buckets of one thread, on their own cache line. */
+typedef struct {
+	sssp_bin_t *bins; // Indexed by bucket, from 0
+	unsigned long num_bins;
+	unsigned long gather_pos; // Where the next bucket goes in the frontier
+	sssp_bin_t spare; // Empty, swapped with the current bucket to drain it
+} __attribute__((aligned(OS_CACHELINE_SIZE))) sssp_local_t;
+
+typedef struct {
+	os_threadpool_t *tp;
+	os_graph_t *graph;
+	unsigned long *dist;
+	unsigned long delta;
+	unsigned long bucket; // Bucket being processed
+
+	/* Nodes of the current bucket, duplicates possible. */
+	unsigned int *frontier;
+	unsigned long frontier_size;
+	unsigned long frontier_capacity;
+
+	sssp_local_t *locals; // One per threadpool_worker_id()
+} sssp_state_t;
+
+/*
+ * Mean of (up to) SSSP_DELTA_SAMPLES edge weights, spread over the
+ * adjacency: buckets are then about one edge wide. At least 1.
+ */
+unsigned long sssp_default_delta(const os_graph_t *graph)
+{
+	unsigned long num_adj = graph->offsets[graph->num_nodes];
+	unsigned long samples = num_adj < SSSP_DELTA_SAMPLES ? num_adj : SSSP_DELTA_SAMPLES;
+	unsigned long total = 0;
+
+	if (graph->weights == NULL || samples == 0)
+		return 1;
+
+	for (unsigned long i = 0; i < samples; i++)
+		total += graph->weights[i * (num_adj / samples)];
+
+	return total / samples > 0 ? total / samples : 1;
+}
+
+static void bin_push(sssp_local_t *local, unsigned long bucket, unsigned int node)
+{
+	sssp_bin_t *bin;
+
+	if (bucket >= local->num_bins) {
+		unsigned long num_bins = 2 * local->num_bins > bucket ?
+			2 * local->num_bins : bucket + 1;
+
+		local->bins = realloc(local->bins, num_bins * sizeof(*local->bins));
+		DIE(local->bins == NULL, "realloc");
+		memset(local->bins + local->num_bins, 0,
+				(num_bins - local->num_bins) * sizeof(*local->bins));
+		local->num_bins = num_bins;
+	}
+
+	bin = &local->bins[bucket];
+	if (bin->count == bin->size) {
+		bin->size = bin->size != 0 ? 2 * bin->size : SSSP_BIN_INITIAL_SIZE;
+		bin->nodes = realloc(bin->nodes, bin->size * sizeof(*bin->nodes));
+		DIE(bin->nodes == NULL, "realloc");
+	}
+	bin->nodes[bin->count++] = node;
+}
+
+/*
+ * Lower the distance of 'v' to 'dist', unless it is lower already.
+ * Return 1 if the caller did lower it.
+ */
+static inline int sssp_lower(unsigned long *dist, unsigned int v, unsigned long d)
+{
+	unsigned long old = __atomic_load_n(&dist[v], __ATOMIC_RELAXED);
+
+	while (d < old)
+		if (__atomic_compare_exchange_n(&dist[v], &old, d, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * Relax the edges of node 'u', filing every neighbour whose distance
+ * drops into the bucket of its new distance.
+ */
+static void sssp_relax_node(sssp_state_t *s, sssp_local_t *local, unsigned int u)
+{
+	os_graph_t *graph = s->graph;
+	unsigned long du = __atomic_load_n(&s->dist[u], __ATOMIC_RELAXED);
+	unsigned long pos = graph->offsets[u];
+	os_neighbour_iter_t it;
+	unsigned int v;
+
+	/* Stale: lowered into an earlier bucket since, and relaxed there. */
+	if (du / s->delta < s->bucket)
+		return;
+
+	graph_iter_init(&it, graph, u);
+	while (graph_iter_next(&it, v)) {
+		unsigned long dv = du + graph_weight(graph, pos++);
+
+		if (sssp_lower(s->dist, v, dv))
+			bin_push(local, dv / s->delta, v);
+	}
+}
+
+/*
+ * Relax the nodes a thread filed into the current bucket itself, for as
+ * long as they stay fewer than SSSP_DRAIN_SIZE: as in GAP, small buckets
+ * are finished locally rather than in rounds over all the threads, which
+ * cost more than the work itself on graphs of large diameter.
+ */
+static void sssp_drain(sssp_state_t *s, sssp_local_t *local)
+{
+	while (s->bucket < local->num_bins) {
+		sssp_bin_t work = local->bins[s->bucket];
+
+		if (work.count == 0 || work.count >= SSSP_DRAIN_SIZE)
+			break;
+
+		/* Refiled nodes go to the spare, while 'work' is relaxed. */
+		local->bins[s->bucket] = local->spare;
+		for (unsigned long i = 0; i < work.count; i++)
+			sssp_relax_node(s, local, work.nodes[i]);
+
+		work.count = 0;
+		local->spare = work;
+	}
+}
+
+/* Relax the frontier nodes [first, last), then drain what they refiled. */
+static void sssp_relax(void *arg, unsigned long first, unsigned long last)
+{
+	sssp_state_t *s = (sssp_state_t *) arg;
+	sssp_local_t *local = &s->locals[threadpool_worker_id(s->tp)];
+
+	for (unsigned long i = first; i < last; i++)
+		sssp_relax_node(s, local, s->frontier[i]);
+
+	sssp_drain(s, local);
+}
+
+/* Move the current bucket of every thread into the frontier. */
+static void sssp_gather(sssp_state_t *s)
+{
+	unsigned int num_locals = s->tp->num_threads + 1;
+
+	for (unsigned int t = 0; t < num_locals; t++) {
+		sssp_local_t *local = &s->locals[t];
+		sssp_bin_t *bin;
+
+		if (s->bucket >= local->num_bins)
+			continue;
+
+		bin = &local->bins[s->bucket];
+		memcpy(s->frontier + local->gather_pos, bin->nodes,
+				bin->count * sizeof(*bin->nodes));
+		free(bin->nodes);
+		memset(bin, 0, sizeof(*bin));
+	}
+}
+
+/*
+ * Lowest bucket, from the current one on, that a thread filed nodes
+ * into. Return 0 if there is none left, 1 with 's->bucket' set to it and
+ * the frontier sized and laid out for it otherwise.
+ */
+static int sssp_next_bucket(sssp_state_t *s)
+{
+	unsigned int num_locals = s->tp->num_threads + 1;
+	unsigned long next = GRAPH_UNREACHABLE;
+	unsigned long size = 0;
+
+	for (unsigned int t = 0; t < num_locals; t++) {
+		sssp_local_t *local = &s->locals[t];
+
+		for (unsigned long b = s->bucket; b < local->num_bins && b < next; b++) {
+			if (local->bins[b].count != 0) {
+				next = b;
+				break;
+			}
+		}
+	}
+	if (next == GRAPH_UNREACHABLE)
+		return 0;
+
+	for (unsigned int t = 0; t < num_locals; t++) {
+		sssp_local_t *local = &s->locals[t];
+
+		local->gather_pos = size;
+		if (next < local->num_bins)
+			size += local->bins[next].count;
+	}
+
+	if (size > s->frontier_capacity) {
+		s->frontier_capacity = size;
+		free(s->frontier);
+		s->frontier = malloc(size * sizeof(*s->frontier));
+		DIE(s->frontier == NULL, "malloc");
+	}
+	s->bucket = next;
+	s->frontier_size = size;
+
+	return 1;
+}
+
+/*
+ * Distances of all nodes from 'root' on the threads of 'tp', with buckets
+ * 'delta' wide (0 for sssp_default_delta()). Unreached nodes are at
+ * GRAPH_UNREACHABLE. The caller frees the returned array.
+ */
+unsigned long *sssp_delta_stepping(os_threadpool_t *tp, os_graph_t *graph, unsigned int root,
+		unsigned long delta)
+{
+	unsigned int num_locals = tp->num_threads + 1;
+	sssp_state_t s;
+
+	s.dist = malloc(graph->num_nodes * sizeof(*s.dist));
+	DIE(s.dist == NULL && graph->num_nodes != 0, "malloc");
+	memset(s.dist, 0xff, graph->num_nodes * sizeof(*s.dist));
+	if (root >= graph->num_nodes)
+		return s.dist;
+
+	s.tp = tp;
+	s.graph = graph;
+	s.delta = delta != 0 ? delta : sssp_default_delta(graph);
+	s.bucket = 0;
+	s.frontier_capacity = SSSP_BIN_INITIAL_SIZE;
+	s.frontier = malloc(s.frontier_capacity * sizeof(*s.frontier));
+	s.locals = aligned_alloc(OS_CACHELINE_SIZE, num_locals * sizeof(*s.locals));
+	DIE(s.frontier == NULL || s.locals == NULL, "malloc");
+	memset(s.locals, 0, num_locals * sizeof(*s.locals));
+
+	s.dist[root] = 0;
+	s.frontier[0] = root;
+	s.frontier_size = 1;
+
+	while (1) {
+		unsigned long grain = s.frontier_size /
+			(tp->num_threads * OS_PARALLEL_FOR_CHUNKS_PER_THREAD);
+
+		/* Too few nodes to be worth a job: relax them on this thread. */
+		if (s.frontier_size < SSSP_MIN_GRAIN)
+			sssp_relax(&s, 0, s.frontier_size);
+		else
+			parallel_for(tp, 0, s.frontier_size,
+					grain > SSSP_MIN_GRAIN ? grain : SSSP_MIN_GRAIN, sssp_relax, &s);
+
+		if (!sssp_next_bucket(&s))
+			break;
+		sssp_gather(&s);
+	}
+
+	for (unsigned int t = 0; t < num_locals; t++) {
+		for (unsigned long b = 0; b < s.locals[t].num_bins; b++)
+			free(s.locals[t].bins[b].nodes);
+		free(s.locals[t].bins);
+		free(s.locals[t].spare.nodes);
+	}
+	free(s.locals);
+	free(s.frontier);
+
+	return s.dist;
+}
@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Parallel single-source shortest paths, by delta-stepping, as described
+ * in: "Delta-stepping: a parallelizable shortest path algorithm" (Meyer,
+ * Sanders; Journal of Algorithms, 2003).
+ *
+ * Nodes are kept in buckets of distances 'delta' wide, and the lowest
+ * non-empty bucket is processed as a whole, in parallel: its nodes relax
+ * their edges, and the nodes whose distance drops go to the bucket of
+ * their new distance, the current one included, until it stays empty.
+ * As in the GAP benchmark suite (Beamer, Asanovic, Patterson), each
+ * thread files nodes into buckets of its own, and the next frontier is
+ * gathered from all of them; light and heavy edges are not told apart.
+ * Small buckets are not worth a round over all the threads: a bucket
+ * too small to split is relaxed on the calling thread, and each thread
+ * keeps relaxing what it refiles into the current bucket while that
+ * stays small.
+ */
+
+#ifndef __OS_SSSP_H__
+#define __OS_SSSP_H__	1
+
+#include "os_graph.h"
+#include "os_threadpool.h"
+
+/* Fewest frontier nodes per task. */
+#define SSSP_MIN_GRAIN		64
+/* A thread relaxes what it refiles into the current bucket while fewer than this. */
+#define SSSP_DRAIN_SIZE		1024
+/* Edge weights sampled to pick the default delta, their mean. */
+#define SSSP_DELTA_SAMPLES	1024
+
+unsigned long sssp_default_delta(const os_graph_t *graph);
+unsigned long *sssp_delta_stepping(os_threadpool_t *tp, os_graph_t *graph, unsigned int root,
+		unsigned long delta);
+
+#endif
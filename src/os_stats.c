@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "os_stats.h"
+#include "os_task_pool.h"
+#include "os_timer.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* Thread writing a dump every time the signal arrives. */
+static struct {
+	pthread_t thread;
+	os_threadpool_t *tp;
+	int signo;
+	const char *path;
+	int running;
+	atomic_int stop;
+} dumper;
+
+/* Add up the counters of all threads, outside ones included. */
+void stats_sum(os_threadpool_t *tp, os_worker_stats_t *total)
+{
+	memset(total, 0, sizeof(*total));
+
+	for (unsigned int i = 0; i <= tp->num_threads; i++) {
+		const os_worker_stats_t *s = &tp->stats[i];
+
+		total->tasks += s->tasks;
+		total->busy_ns += s->busy_ns;
+		total->idle_ns += s->idle_ns;
+		total->wakeups += s->wakeups;
+		total->lock_waits += s->lock_waits;
+		total->lock_wait_ns += s->lock_wait_ns;
+		total->steals += s->steals;
+		total->steal_attempts += s->steal_attempts;
+		if (s->max_queue_depth > total->max_queue_depth)
+			total->max_queue_depth = s->max_queue_depth;
+	}
+}
+
+static void write_counters(FILE *f, const os_worker_stats_t *s)
+{
+	fprintf(f, "\"tasks\": %lu, \"busy_s\": %.6f, \"idle_s\": %.6f, \"wakeups\": %lu, ",
+			s->tasks, s->busy_ns / 1e9, s->idle_ns / 1e9, s->wakeups);
+	fprintf(f, "\"lock_waits\": %lu, \"lock_wait_s\": %.6f, ",
+			s->lock_waits, s->lock_wait_ns / 1e9);
+	fprintf(f, "\"steals\": %lu, \"steal_attempts\": %lu, \"max_queue_depth\": %lu",
+			s->steals, s->steal_attempts, s->max_queue_depth);
+}
+
+void stats_write_json(os_threadpool_t *tp, FILE *f)
+{
+	os_task_pool_stats_t pool;
+	os_worker_stats_t total;
+
+	stats_sum(tp, &total);
+	task_pool_get_stats(&pool);
+
+	fprintf(f, "{\n \"threads\": %u,\n \"policy\": \"%s\",\n \"uptime_s\": %.6f,\n",
+			tp->num_threads, tp->policy == OS_SCHED_WORK_STEALING ? "steal" : "shared",
+			(timer_now_ns() - tp->start_ns) / 1e9);
+
+	fprintf(f, " \"total\": {");
+	write_counters(f, &total);
+	fprintf(f, "},\n \"workers\": [\n");
+	for (unsigned int i = 0; i < tp->num_threads; i++) {
+		fprintf(f, "  {\"id\": %u, ", i);
+		write_counters(f, &tp->stats[i]);
+		fprintf(f, "}%s\n", i + 1 < tp->num_threads ? "," : "");
+	}
+	fprintf(f, " ],\n \"outside\": {");
+	write_counters(f, &tp->stats[tp->num_threads]);
+	fprintf(f, "},\n");
+
+	fprintf(f, " \"task_pool\": {\"task_allocs\": %lu, \"slab_refills\": %lu, ",
+			pool.task_allocs, pool.slab_refills);
+	fprintf(f, "\"inline_args\": %lu, \"heap_args\": %lu}\n}\n",
+			pool.inline_args, pool.heap_args);
+}
+
+/* Write the counters to 'path', replacing its contents, or to stderr for "-". */
+int stats_dump(os_threadpool_t *tp, const char *path)
+{
+	FILE *f;
+
+	if (strcmp(path, "-") == 0) {
+		stats_write_json(tp, stderr);
+		return 0;
+	}
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		log_error("Can't open %s: %s", path, strerror(errno));
+		return -1;
+	}
+	stats_write_json(tp, f);
+	if (fclose(f) != 0) {
+		log_error("Can't write %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Block 'signo' in the calling thread, and so in the threads it creates
+ * afterwards, so that only the thread of stats_signal_start() gets it.
+ * To be called before creating any other thread.
+ */
+void stats_signal_block(int signo)
+{
+	sigset_t set;
+	int rc;
+
+	sigemptyset(&set);
+	sigaddset(&set, signo);
+	rc = pthread_sigmask(SIG_BLOCK, &set, NULL);
+	DIE(rc != 0, "pthread_sigmask");
+}
+
+static void *dumper_loop(void *arg)
+{
+	sigset_t set;
+	int signo;
+
+	(void) arg;
+
+	sigemptyset(&set);
+	sigaddset(&set, dumper.signo);
+
+	while (1) {
+		if (sigwait(&set, &signo) != 0)
+			continue;
+		if (atomic_load(&dumper.stop))
+			break;
+		stats_dump(dumper.tp, dumper.path);
+	}
+
+	return NULL;
+}
+
+/*
+ * Dump the counters of 'tp' to 'path' (see stats_dump()) whenever the
+ * process gets 'signo', blocked beforehand with stats_signal_block().
+ */
+void stats_signal_start(os_threadpool_t *tp, int signo, const char *path)
+{
+	int rc;
+
+	dumper.tp = tp;
+	dumper.signo = signo;
+	dumper.path = path;
+	atomic_init(&dumper.stop, 0);
+
+	rc = pthread_create(&dumper.thread, NULL, dumper_loop, NULL);
+	DIE(rc != 0, "pthread_create");
+	dumper.running = 1;
+}
+
+/* Stop the thread of stats_signal_start(), if any. */
+void stats_signal_stop(void)
+{
+	if (!dumper.running)
+		return;
+
+	atomic_store(&dumper.stop, 1);
+	pthread_kill(dumper.thread, dumper.signo);
+	pthread_join(dumper.thread, NULL);
+	dumper.running = 0;
+}
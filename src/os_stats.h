@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Export of the threadpool counters, as JSON:
+ *
+ *   {
+ *     "threads": <n>, "policy": "shared"|"steal", "uptime_s": <s>,
+ *     "total": {<counters>},
+ *     "workers": [{"id": <i>, <counters>}, ...],
+ *     "outside": {<counters>},
+ *     "task_pool": {<os_task_pool_stats_t>}
+ *   }
+ *
+ * Times are in seconds. In "total", "max_queue_depth" is the largest of
+ * all threads, other counters are sums. "outside" holds what threads out
+ * of the threadpool (the main thread) did, such as enqueueing.
+ *
+ * The counters are read as they are, so a dump taken while tasks run is
+ * only a close estimate, which leaves out the task or wait in progress in
+ * each thread. One taken once the threadpool is idle is exact.
+ */
+
+#ifndef __OS_STATS_H__
+#define __OS_STATS_H__	1
+
+#include <stdio.h>
+
+#include "os_threadpool.h"
+
+void stats_sum(os_threadpool_t *tp, os_worker_stats_t *total);
+void stats_write_json(os_threadpool_t *tp, FILE *f);
+int stats_dump(os_threadpool_t *tp, const char *path);
+
+void stats_signal_block(int signo);
+void stats_signal_start(os_threadpool_t *tp, int signo, const char *path);
+void stats_signal_stop(void);
+
+#endif
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "os_task_pool.h"
+#include "log/log.h"
+#include "utils.h"
+
+#define TASK_SLAB_SIZE		64	// Tasks carved out of one slab
+#define TASK_CACHE_MAX		256	// Free tasks a thread keeps at most
+#define TASK_CACHE_BATCH	128	// Tasks moved at once between a thread and the depot
+
+typedef struct os_task_slab {
+	struct os_task_slab *next;
+	os_task_t tasks[TASK_SLAB_SIZE];
+} os_task_slab_t;
+
+/*
+ * Per-thread cache. Free tasks are chained through 'list.next', and only
+ * the owner thread touches 'free', 'count' and 'stats'.
+ */
+typedef struct os_task_cache {
+	os_list_node_t *free;
+	unsigned int count;
+	os_task_pool_stats_t stats;
+	os_list_node_t node; // Link in the list of live caches
+} os_task_cache_t;
+
+/* Shared state, protected by 'lock'. */
+static struct {
+	pthread_mutex_t lock;
+	os_list_node_t *depot; // Free tasks given back by threads
+	unsigned int depot_count;
+	os_task_slab_t *slabs; // Every slab ever allocated
+	os_list_node_t caches; // Caches of the live threads
+	os_task_pool_stats_t retired; // Counters of the exited threads
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.caches = { &pool.caches, &pool.caches },
+};
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_key_t cache_key;
+static __thread os_task_cache_t *cache;
+
+static void stats_add(os_task_pool_stats_t *dst, const os_task_pool_stats_t *src)
+{
+	dst->task_allocs += src->task_allocs;
+	dst->slab_refills += src->slab_refills;
+	dst->inline_args += src->inline_args;
+	dst->heap_args += src->heap_args;
+}
+
+/* Detach the first 'n' tasks of the chain '*head'. Return the last one. */
+static os_list_node_t *chain_cut(os_list_node_t **head, unsigned int n)
+{
+	os_list_node_t *last = *head;
+
+	for (unsigned int i = 1; i < n; i++)
+		last = last->next;
+	*head = last->next;
+	last->next = NULL;
+
+	return last;
+}
+
+/* Thread exit: give the free tasks to the depot and keep the counters. */
+static void cache_release(void *arg)
+{
+	os_task_cache_t *c = (os_task_cache_t *) arg;
+
+	pthread_mutex_lock(&pool.lock);
+	if (c->count > 0) {
+		os_list_node_t *first = c->free;
+		os_list_node_t *last = chain_cut(&c->free, c->count);
+
+		last->next = pool.depot;
+		pool.depot = first;
+		pool.depot_count += c->count;
+	}
+	stats_add(&pool.retired, &c->stats);
+	list_del(&c->node);
+	pthread_mutex_unlock(&pool.lock);
+
+	free(c);
+}
+
+static void pool_init(void)
+{
+	int rc = pthread_key_create(&cache_key, cache_release);
+
+	DIE(rc != 0, "pthread_key_create");
+}
+
+static os_task_cache_t *get_cache(void)
+{
+	if (cache != NULL)
+		return cache;
+
+	pthread_once(&pool_once, pool_init);
+
+	cache = calloc(1, sizeof(*cache));
+	DIE(cache == NULL, "calloc");
+	pthread_setspecific(cache_key, cache);
+
+	pthread_mutex_lock(&pool.lock);
+	list_add_tail(&pool.caches, &cache->node);
+	pthread_mutex_unlock(&pool.lock);
+
+	return cache;
+}
+
+/* Refill an empty cache: from the depot if possible, else from a new slab. */
+static void cache_refill(os_task_cache_t *c)
+{
+	os_task_slab_t *slab;
+
+	pthread_mutex_lock(&pool.lock);
+	if (pool.depot_count > 0) {
+		unsigned int n = pool.depot_count < TASK_CACHE_BATCH ? pool.depot_count : TASK_CACHE_BATCH;
+
+		c->free = pool.depot;
+		chain_cut(&pool.depot, n);
+		pool.depot_count -= n;
+		c->count = n;
+		pthread_mutex_unlock(&pool.lock);
+		return;
+	}
+	pthread_mutex_unlock(&pool.lock);
+
+	slab = malloc(sizeof(*slab));
+	DIE(slab == NULL, "malloc");
+	c->stats.slab_refills++;
+
+	for (unsigned int i = 0; i < TASK_SLAB_SIZE; i++) {
+		slab->tasks[i].list.next = c->free;
+		c->free = &slab->tasks[i].list;
+	}
+	c->count = TASK_SLAB_SIZE;
+
+	pthread_mutex_lock(&pool.lock);
+	slab->next = pool.slabs;
+	pool.slabs = slab;
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/*
+ * Allocate a task. If 'arg_size' is not 0, 'argument' points to that many
+ * bytes of storage: the inline buffer if large enough, else a malloc()ed
+ * buffer the caller must release through 'destroy_arg'.
+ */
+os_task_t *task_pool_alloc(size_t arg_size)
+{
+	os_task_cache_t *c = get_cache();
+	os_task_t *t;
+
+	if (c->free == NULL)
+		cache_refill(c);
+
+	t = list_entry(c->free, os_task_t, list);
+	c->free = c->free->next;
+	c->count--;
+	c->stats.task_allocs++;
+
+	t->argument = NULL;
+	if (arg_size > OS_TASK_INLINE_ARG_SIZE) {
+		t->argument = malloc(arg_size);
+		DIE(t->argument == NULL, "malloc");
+		c->stats.heap_args++;
+	} else if (arg_size > 0) {
+		t->argument = t->inline_arg;
+		c->stats.inline_args++;
+	}
+
+	return t;
+}
+
+/* Give a task back, to the cache of the calling thread. */
+void task_pool_free(os_task_t *t)
+{
+	os_task_cache_t *c = get_cache();
+
+	t->list.next = c->free;
+	c->free = &t->list;
+
+	if (++c->count > TASK_CACHE_MAX) {
+		os_list_node_t *first = c->free;
+		os_list_node_t *last = chain_cut(&c->free, TASK_CACHE_BATCH);
+
+		pthread_mutex_lock(&pool.lock);
+		last->next = pool.depot;
+		pool.depot = first;
+		pool.depot_count += TASK_CACHE_BATCH;
+		pthread_mutex_unlock(&pool.lock);
+
+		c->count -= TASK_CACHE_BATCH;
+	}
+}
+
+/*
+ * Sum up the counters of all threads. Counters of running threads are
+ * read without synchronization, so call this when the threads are idle.
+ */
+void task_pool_get_stats(os_task_pool_stats_t *stats)
+{
+	os_list_node_t *n;
+
+	pthread_mutex_lock(&pool.lock);
+	*stats = pool.retired;
+	list_for_each(n, &pool.caches)
+		stats_add(stats, &list_entry(n, os_task_cache_t, node)->stats);
+	pthread_mutex_unlock(&pool.lock);
+}
+
+/*
+ * Free all slabs. Every task must have been destroyed and the calling
+ * thread must be the only one left that used the pool.
+ */
+void task_pool_cleanup(void)
+{
+	pthread_mutex_lock(&pool.lock);
+	while (pool.slabs != NULL) {
+		os_task_slab_t *next = pool.slabs->next;
+
+		free(pool.slabs);
+		pool.slabs = next;
+	}
+	pool.depot = NULL;
+	pool.depot_count = 0;
+	pthread_mutex_unlock(&pool.lock);
+
+	if (cache != NULL) {
+		pthread_setspecific(cache_key, NULL);
+		cache->count = 0;
+		cache_release(cache);
+		cache = NULL;
+	}
+}
@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Allocator for os_task_t.
+ *
+ * Tasks are carved out of slabs and recycled through per-thread free
+ * lists, so creating and destroying tasks in steady state neither calls
+ * malloc() nor takes a lock. Threads holding too many free tasks give a
+ * batch back to a shared depot, where other threads refill from.
+ */
+
+#ifndef __OS_TASK_POOL_H__
+#define __OS_TASK_POOL_H__	1
+
+#include "os_threadpool.h"
+
+/*
+ * Allocation counters. Out of 'task_allocs + inline_args' allocations that
+ * would each have called malloc(), only 'slab_refills + heap_args' did.
+ */
+typedef struct os_task_pool_stats {
+	unsigned long task_allocs; // Tasks handed out
+	unsigned long slab_refills; // Slabs malloc()ed since no free task was left
+	unsigned long inline_args; // Arguments stored in the task itself
+	unsigned long heap_args; // Arguments too large for that, malloc()ed
+} os_task_pool_stats_t;
+
+os_task_t *task_pool_alloc(size_t arg_size);
+void task_pool_free(os_task_t *t);
+
+void task_pool_get_stats(os_task_pool_stats_t *stats);
+void task_pool_cleanup(void);
+
+#endif
@@ -3,23 +3,124 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "os_threadpool.h"
+#include "os_task_pool.h"
+#include "os_timer.h"
+#include "os_trace.h"
 #include "log/log.h"
 #include "utils.h"
 
+/* Initial number of task slots in a work-stealing deque. */
+#define DEQUE_INITIAL_SIZE	256
+
+/* Per-thread state of the calling thread, NULL outside any threadpool. */
+static __thread os_worker_t *current_worker;
+
+/* Job of the task the calling thread is running, if any. */
+static __thread os_job_t *current_job;
+
+/*
+ * Counters of the calling thread in 'tp': its own, or the slot of the
+ * threads outside the threadpool.
+ */
+static os_worker_stats_t *stats_slot(os_threadpool_t *tp)
+{
+	os_worker_t *self = current_worker;
+
+	return &tp->stats[(self != NULL && self->tp == tp) ? self->id : tp->num_threads];
+}
+
+/* Counter updates, gone when the counters are compiled out. */
+#define STATS_ADD(stats, field, n) \
+	do { if (OS_STATS) (stats)->field += (n); } while (0)
+#define STATS_MAX(stats, field, n) \
+	do { if (OS_STATS && (n) > (stats)->field) (stats)->field = (n); } while (0)
+
+/* Time for the counters, only read when they are compiled in. */
+static inline unsigned long stats_clock(void)
+{
+	return OS_STATS ? timer_now_ns() : 0;
+}
+
+/* Record an event in the trace ring of the thread owning 'stats', when tracing. */
+static inline void trace_record(os_threadpool_t *tp, os_worker_stats_t *stats,
+		os_trace_event_type_t type, unsigned long data)
+{
+	os_trace_t *trace = atomic_load_explicit(&tp->trace, memory_order_acquire);
+
+	if (trace != NULL)
+		trace_event(trace, stats - tp->stats, type, data);
+}
+
+/* Lock 'task_lock', timing (and tracing) the wait if it is taken. */
+static void lock_tasks(os_threadpool_t *tp, os_worker_stats_t *stats)
+{
+	unsigned long start;
+
+	if (!OS_STATS && atomic_load_explicit(&tp->trace, memory_order_relaxed) == NULL) {
+		pthread_mutex_lock(&tp->task_lock);
+		return;
+	}
+
+	if (pthread_mutex_trylock(&tp->task_lock) == 0)
+		return;
+
+	start = stats_clock();
+	trace_record(tp, stats, TRACE_LOCK_BEGIN, 0);
+	pthread_mutex_lock(&tp->task_lock);
+	trace_record(tp, stats, TRACE_LOCK_END, 0);
+	STATS_ADD(stats, lock_waits, 1);
+	STATS_ADD(stats, lock_wait_ns, stats_clock() - start);
+}
+
 /* Create a task that would be executed by a thread. */
 os_task_t *create_task(void (*action)(void *), void *arg, void (*destroy_arg)(void *))
 {
 	os_task_t *t;
 
-	t = malloc(sizeof(*t));
-	DIE(t == NULL, "malloc");
+	t = task_pool_alloc(0);
 
 	t->action = action;		// the function
 	t->argument = arg;		// arguments for the function
 	t->destroy_arg = destroy_arg;	// destroy argument function
+	t->job = NULL;
+
+	return t;
+}
+
+/*
+ * Create a task working on its own copy of 'size' bytes at 'arg'.
+ * Small arguments are stored in the task, so creating such a task does
+ * not allocate anything.
+ */
+os_task_t *create_task_copy(void (*action)(void *), const void *arg, size_t size)
+{
+	os_task_t *t;
+
+	t = create_task_sized(action, size);
+	memcpy(t->argument, arg, size);
+
+	return t;
+}
+
+/*
+ * Create a task owning an argument buffer of 'size' bytes, left for the
+ * caller to fill in through 't->argument'. Like create_task_copy(), small
+ * buffers are stored in the task itself.
+ */
+os_task_t *create_task_sized(void (*action)(void *), size_t size)
+{
+	os_task_t *t;
+
+	t = task_pool_alloc(size);
+
+	t->action = action;
+	t->destroy_arg = size > OS_TASK_INLINE_ARG_SIZE ? free : NULL;
+	t->job = NULL;
 
 	return t;
 }
@@ -29,18 +130,75 @@ void destroy_task(os_task_t *t)
 {
 	if (t->destroy_arg != NULL)
 		t->destroy_arg(t->argument);
-	free(t);
+	task_pool_free(t);
+}
+
+/*
+ * Work-stealing enqueue. Threadpool threads push to their own deque,
+ * other threads use the shared queue.
+ */
+static void ws_enqueue_task(os_threadpool_t *tp, os_task_t *t)
+{
+	os_worker_t *self = current_worker;
+	os_worker_stats_t *stats = stats_slot(tp);
+	unsigned long depth;
+
+	if (self != NULL && self->tp == tp) {
+		deque_push(&self->deque, t);
+		depth = deque_size(&self->deque);
+	} else {
+		lock_tasks(tp, stats);
+		list_add_tail(&tp->head, &t->list);
+		depth = atomic_fetch_add(&tp->global_tasks, 1) + 1;
+		pthread_mutex_unlock(&tp->task_lock);
+	}
+	STATS_MAX(stats, max_queue_depth, depth);
+	trace_record(tp, stats, TRACE_ENQUEUE, depth);
+
+	/*
+	 * Publish the task, then check for sleeping threads. A thread going to
+	 * sleep does the opposite (see ws_dequeue_task()), so at least one of
+	 * the two sides sees the other and the wakeup is never lost.
+	 */
+	atomic_fetch_add(&tp->pending_tasks, 1);
+	if (atomic_load(&tp->idle_threads) > 0) {
+		lock_tasks(tp, stats);
+		pthread_cond_signal(&tp->task_cond);
+		pthread_mutex_unlock(&tp->task_lock);
+	}
 }
 
-/* Put a new task to threadpool task queue. */
+/*
+ * Put a new task to threadpool task queue.
+ * A task enqueued by a running task joins the job of the latter, unless
+ * it already belongs to a job.
+ */
 void enqueue_task(os_threadpool_t *tp, os_task_t *t)
 {
+	os_worker_stats_t *stats;
+	unsigned long depth;
+
 	assert(tp != NULL);
 	assert(t != NULL);
 
+	if (t->job == NULL)
+		t->job = current_job;
+	if (t->job != NULL)
+		atomic_fetch_add(&t->job->pending, 1);
+	atomic_fetch_add(&tp->unfinished_tasks, 1);
+
+	if (tp->policy == OS_SCHED_WORK_STEALING) {
+		ws_enqueue_task(tp, t);
+		return;
+	}
+
 	/* Enqueue task to the shared task queue. Use synchronization. */
-	pthread_mutex_lock(&tp->task_lock); // Lock the task queue mutex
+	stats = stats_slot(tp);
+	lock_tasks(tp, stats); // Lock the task queue mutex
 	list_add_tail(&tp->head, &t->list); // Add the task to the end of the queue
+	depth = atomic_fetch_add(&tp->pending_tasks, 1) + 1;
+	STATS_MAX(stats, max_queue_depth, depth);
+	trace_record(tp, stats, TRACE_ENQUEUE, depth);
 	pthread_cond_signal(&tp->task_cond); // Signal a waiting thread that a task is available
 	pthread_mutex_unlock(&tp->task_lock); // Unlock the task queue mutex
 }
@@ -54,6 +212,112 @@ static int queue_is_empty(os_threadpool_t *tp)
 	return list_empty(&tp->head);
 }
 
+/* Pick a victim with a xorshift generator private to the thread. */
+static unsigned int ws_random_victim(os_threadpool_t *tp, os_worker_t *self)
+{
+	unsigned int x = self->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	self->seed = x;
+
+	return x % tp->num_threads;
+}
+
+/*
+ * Look for a task without blocking: in the own deque first, then in the
+ * shared queue, then in the deques of a few random victims.
+ */
+static os_task_t *ws_find_task(os_threadpool_t *tp, os_worker_t *self,
+		os_worker_stats_t *stats)
+{
+	os_task_t *t = NULL;
+
+	if (self != NULL) {
+		t = deque_take(&self->deque);
+		if (t != NULL)
+			return t;
+	}
+
+	if (atomic_load(&tp->global_tasks) > 0) {
+		lock_tasks(tp, stats);
+		if (!queue_is_empty(tp)) {
+			os_list_node_t *node = tp->head.next;
+
+			list_del(node);
+			atomic_fetch_sub(&tp->global_tasks, 1);
+			t = list_entry(node, os_task_t, list);
+		}
+		pthread_mutex_unlock(&tp->task_lock);
+		if (t != NULL)
+			return t;
+	}
+
+	if (self == NULL)
+		return NULL;
+
+	for (unsigned int i = 0; i < 2 * tp->num_threads; i++) {
+		os_worker_t *victim = &tp->workers[ws_random_victim(tp, self)];
+
+		if (victim == self)
+			continue;
+
+		t = deque_steal(&victim->deque);
+		STATS_ADD(stats, steal_attempts, 1);
+		if (t != NULL && t != DEQUE_ABORT) {
+			STATS_ADD(stats, steals, 1);
+			return t;
+		}
+	}
+
+	return NULL;
+}
+
+/* Work-stealing dequeue. Same semantics as dequeue_task(). */
+static os_task_t *ws_dequeue_task(os_threadpool_t *tp)
+{
+	os_worker_t *self = current_worker;
+	os_worker_stats_t *stats = stats_slot(tp);
+	unsigned long start;
+	int shutdown;
+
+	if (self != NULL && self->tp != tp)
+		self = NULL;
+
+	while (1) {
+		os_task_t *t = ws_find_task(tp, self, stats);
+
+		if (t != NULL) {
+			atomic_fetch_sub(&tp->pending_tasks, 1);
+			return t;
+		}
+
+		/*
+		 * Nothing found. Sleep, unless a task was enqueued meanwhile: it may
+		 * sit in a deque we did not look into, or have lost a race for.
+		 */
+		lock_tasks(tp, stats);
+		atomic_fetch_add(&tp->idle_threads, 1);
+		if (atomic_load(&tp->pending_tasks) == 0 && !tp->shutdown) {
+			start = stats_clock();
+			trace_record(tp, stats, TRACE_IDLE_BEGIN, 0);
+			do {
+				pthread_cond_wait(&tp->task_cond, &tp->task_lock);
+				STATS_ADD(stats, wakeups, 1);
+			} while (atomic_load(&tp->pending_tasks) == 0 && !tp->shutdown);
+			trace_record(tp, stats, TRACE_IDLE_END, 0);
+			STATS_ADD(stats, idle_ns, stats_clock() - start);
+		}
+		atomic_fetch_sub(&tp->idle_threads, 1);
+		shutdown = tp->shutdown;
+		pthread_mutex_unlock(&tp->task_lock);
+
+		if (shutdown)
+			return NULL;
+	}
+}
+
 /*
  * Get a task from threadpool task queue.
  * Block if no task is available.
@@ -62,14 +326,27 @@ static int queue_is_empty(os_threadpool_t *tp)
  */
 os_task_t *dequeue_task(os_threadpool_t *tp)
 {
+	os_worker_stats_t *stats;
 	os_task_t *t = NULL;
+	unsigned long start;
+
+	if (tp->policy == OS_SCHED_WORK_STEALING)
+		return ws_dequeue_task(tp);
 
 	/* Dequeue task from the shared task queue. Use synchronization. */
-	pthread_mutex_lock(&tp->task_lock);
+	stats = stats_slot(tp);
+	lock_tasks(tp, stats);
 
 	// Wait for a task to become available or for the threadpool to shut down
-	while (queue_is_empty(tp) && !tp->shutdown) {/* && not shutting down condition */
-		pthread_cond_wait(&tp->task_cond, &tp->task_lock);
+	if (queue_is_empty(tp) && !tp->shutdown) {
+		start = stats_clock();
+		trace_record(tp, stats, TRACE_IDLE_BEGIN, 0);
+		do {
+			pthread_cond_wait(&tp->task_cond, &tp->task_lock);
+			STATS_ADD(stats, wakeups, 1);
+		} while (queue_is_empty(tp) && !tp->shutdown);
+		trace_record(tp, stats, TRACE_IDLE_END, 0);
+		STATS_ADD(stats, idle_ns, stats_clock() - start);
 	}
 
 	// If the thread pool is shutting down, release mutex and return NULL
@@ -83,6 +360,7 @@ os_task_t *dequeue_task(os_threadpool_t *tp)
 		os_list_node_t *node = tp->head.next;
 
 		list_del(node);
+		atomic_fetch_sub(&tp->pending_tasks, 1);
 		t = list_entry(node, os_task_t, list);
 	}
 
@@ -91,10 +369,119 @@ os_task_t *dequeue_task(os_threadpool_t *tp)
 	return t;
 }
 
+/*
+ * Take a task if one is at hand, without blocking: the counterpart of
+ * dequeue_task() for threads that have something else to wait for.
+ */
+static os_task_t *try_dequeue_task(os_threadpool_t *tp)
+{
+	os_worker_t *self = current_worker;
+	os_worker_stats_t *stats = stats_slot(tp);
+	os_task_t *t = NULL;
+
+	if (tp->policy == OS_SCHED_WORK_STEALING) {
+		t = ws_find_task(tp, (self != NULL && self->tp == tp) ? self : NULL, stats);
+		if (t != NULL)
+			atomic_fetch_sub(&tp->pending_tasks, 1);
+		return t;
+	}
+
+	if (atomic_load(&tp->pending_tasks) == 0)
+		return NULL;
+
+	lock_tasks(tp, stats);
+	if (!queue_is_empty(tp)) {
+		os_list_node_t *node = tp->head.next;
+
+		list_del(node);
+		atomic_fetch_sub(&tp->pending_tasks, 1);
+		t = list_entry(node, os_task_t, list);
+	}
+	pthread_mutex_unlock(&tp->task_lock);
+
+	return t;
+}
+
+/*
+ * Index of the calling thread in 'tp', in [0, num_threads).
+ * Threads outside the threadpool all get 'num_threads'. Handy to index
+ * per-thread data, with one extra slot for the main thread.
+ */
+unsigned int threadpool_worker_id(os_threadpool_t *tp)
+{
+	os_worker_t *self = current_worker;
+
+	return (self != NULL && self->tp == tp) ? self->id : tp->num_threads;
+}
+
+/*
+ * Number of tasks enqueued but not picked up by a thread yet. Only a
+ * hint, the value may change as soon as it is read.
+ */
+unsigned int threadpool_queue_depth(os_threadpool_t *tp)
+{
+	return atomic_load_explicit(&tp->pending_tasks, memory_order_relaxed);
+}
+
+/*
+ * Drop one from a counter of unfinished tasks and wake up its waiters when
+ * it reaches 0. The last decrement is done under 'lock': a waiter may only
+ * see 0 once the finishing thread is done with 'lock' and 'cond', so the
+ * waiter is free to destroy them as soon as it returns.
+ */
+static void finish_one(atomic_int *counter, pthread_mutex_t *lock, pthread_cond_t *cond)
+{
+	int old = atomic_load(counter);
+
+	while (old > 1)
+		if (atomic_compare_exchange_weak(counter, &old, old - 1))
+			return;
+
+	pthread_mutex_lock(lock);
+	if (atomic_fetch_sub(counter, 1) == 1)
+		pthread_cond_broadcast(cond);
+	pthread_mutex_unlock(lock);
+}
+
+/* Block until a counter of unfinished tasks drops to 0. */
+static void wait_for_zero(atomic_int *counter, pthread_mutex_t *lock, pthread_cond_t *cond)
+{
+	pthread_mutex_lock(lock);
+	while (atomic_load(counter) > 0)
+		pthread_cond_wait(cond, lock);
+	pthread_mutex_unlock(lock);
+}
+
+/* Run a dequeued task, then account for its completion. */
+static void run_task(os_threadpool_t *tp, os_task_t *t)
+{
+	os_worker_stats_t *stats = stats_slot(tp);
+	os_job_t *saved_job = current_job;
+	os_job_t *job = t->job;
+	unsigned long start = stats_clock();
+
+	current_job = job;
+	trace_record(tp, stats, TRACE_TASK_BEGIN, (unsigned long) t->action);
+	t->action(t->argument);
+	trace_record(tp, stats, TRACE_TASK_END, 0);
+	current_job = saved_job;
+
+	STATS_ADD(stats, tasks, 1);
+	STATS_ADD(stats, busy_ns, stats_clock() - start);
+
+	destroy_task(t);
+	if (job != NULL)
+		finish_one(&job->pending, &job->lock, &job->cond);
+	finish_one(&tp->unfinished_tasks, &tp->finished_tasks_mutex, &tp->finished_tasks_cond);
+}
+
 /* Loop function for threads */
 static void *thread_loop_function(void *arg)
 {
-	os_threadpool_t *tp = (os_threadpool_t *) arg;
+	os_worker_t *self = (os_worker_t *) arg;
+	os_threadpool_t *tp = self->tp;
+
+	current_worker = self;
 
 	while (1) {
 		os_task_t *t;
@@ -102,37 +489,196 @@ static void *thread_loop_function(void *arg)
 		t = dequeue_task(tp);
 		if (t == NULL)
 			break;
-		t->action(t->argument);
-		destroy_task(t);
+		run_task(tp, t);
 	}
 
 	return NULL;
 }
 
-/* Wait completion of all threads. This is to be called by the main thread. */
+/*
+ * Wait until the threadpool is idle, i.e. every enqueued task, including
+ * the ones enqueued by other tasks, has finished. The threads keep running
+ * and take new tasks afterwards. This is to be called by the main thread
+ * (or any thread outside the threadpool).
+ */
 void wait_for_completion(os_threadpool_t *tp)
 {
-	// Wait for the signal indicating all tasks are finished
-	pthread_mutex_lock(&tp->finished_tasks_mutex);
-	while (tp->queued_tasks > 0)
-		pthread_cond_wait(&tp->finished_tasks_cond, &tp->finished_tasks_mutex);
-	pthread_mutex_unlock(&tp->finished_tasks_mutex);
+	wait_for_zero(&tp->unfinished_tasks, &tp->finished_tasks_mutex, &tp->finished_tasks_cond);
+}
+
+/*
+ * Stop and join all threads. Tasks still queued are not run; they are
+ * destroyed by destroy_threadpool(). Calling it again does nothing.
+ */
+void shutdown_threadpool(os_threadpool_t *tp)
+{
+	int already_down;
 
 	// Signal all threads to shut down
 	pthread_mutex_lock(&tp->task_lock);
+	already_down = tp->shutdown;
 	tp->shutdown = 1;
 	pthread_cond_broadcast(&tp->task_cond);
 	pthread_mutex_unlock(&tp->task_lock);
 
+	if (already_down)
+		return;
+
 	/* Join all worker threads. */
 	for (unsigned int i = 0; i < tp->num_threads; i++)
 		pthread_join(tp->threads[i], NULL);
 }
 
-/* Create a new threadpool. */
-os_threadpool_t *create_threadpool(unsigned int num_threads)
+void job_init(os_job_t *job)
+{
+	pthread_condattr_t attr;
+
+	atomic_init(&job->pending, 0);
+	pthread_mutex_init(&job->lock, NULL);
+
+	/* wait_for_job() sleeps with a timeout, on the monotonic clock. */
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&job->cond, &attr);
+	pthread_condattr_destroy(&attr);
+}
+
+/* Destroy a job. Its tasks must have been waited for. */
+void job_destroy(os_job_t *job)
+{
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->cond);
+}
+
+/* Enqueue a task as part of 'job'. */
+void enqueue_job_task(os_threadpool_t *tp, os_job_t *job, os_task_t *t)
+{
+	t->job = job;
+	enqueue_task(tp, t);
+}
+
+/*
+ * Wait until all tasks of 'job' have finished, including the tasks they
+ * enqueued. Other jobs may still be running.
+ *
+ * The calling thread runs queued tasks meanwhile, of any job, so that a
+ * task may wait for a job of its own without holding up a thread: even
+ * with every thread waiting, the tasks of the innermost jobs still run.
+ * With nothing to run, the tasks of 'job' are running elsewhere; the
+ * thread sleeps until they finish, looking again for tasks they may have
+ * enqueued every OS_JOB_HELP_SLEEP_NS.
+ */
+void wait_for_job(os_threadpool_t *tp, os_job_t *job)
+{
+	os_worker_stats_t *stats = stats_slot(tp);
+
+	while (atomic_load(&job->pending) > 0) {
+		os_task_t *t = try_dequeue_task(tp);
+		struct timespec deadline;
+		unsigned long start;
+
+		if (t != NULL) {
+			run_task(tp, t);
+			continue;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_nsec += OS_JOB_HELP_SLEEP_NS;
+		if (deadline.tv_nsec >= 1000000000L) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+
+		pthread_mutex_lock(&job->lock);
+		if (atomic_load(&job->pending) > 0) {
+			start = stats_clock();
+			trace_record(tp, stats, TRACE_IDLE_BEGIN, 0);
+			pthread_cond_timedwait(&job->cond, &job->lock, &deadline);
+			trace_record(tp, stats, TRACE_IDLE_END, 0);
+			STATS_ADD(stats, wakeups, 1);
+			STATS_ADD(stats, idle_ns, stats_clock() - start);
+		}
+		pthread_mutex_unlock(&job->lock);
+	}
+
+	/* Wait for the last task to be done with the job (see finish_one()). */
+	wait_for_zero(&job->pending, &job->lock, &job->cond);
+}
+
+/* Loop shared by the range tasks of a parallel_for() call. */
+typedef struct {
+	void (*fn)(void *arg, unsigned long first, unsigned long last);
+	void *arg;
+	unsigned long grain;
+	os_threadpool_t *tp;
+} parallel_for_t;
+
+/* Range task argument. */
+typedef struct {
+	parallel_for_t *loop;
+	unsigned long first;
+	unsigned long last;
+} parallel_for_range_t;
+
+/*
+ * Halve the range until it is down to the grain, handing the upper halves
+ * over to new tasks (of the same job), then run the loop over the rest.
+ * Idle threads thus take the largest pieces left first.
+ */
+static void parallel_for_function(void *arg)
+{
+	parallel_for_range_t r = *(parallel_for_range_t *) arg;
+
+	while (r.last - r.first > r.loop->grain) {
+		parallel_for_range_t upper = r;
+
+		upper.first = r.first + (r.last - r.first) / 2;
+		r.last = upper.first;
+		enqueue_task(r.loop->tp, create_task_copy(parallel_for_function, &upper, sizeof(upper)));
+	}
+
+	r.loop->fn(r.loop->arg, r.first, r.last);
+}
+
+/*
+ * Call 'fn' over [first, last) on the threads of 'tp', split into ranges
+ * of at most 'grain' items, and return once it is done. A grain of 0
+ * makes OS_PARALLEL_FOR_CHUNKS_PER_THREAD ranges per thread. Like
+ * wait_for_job(), this may be called by threadpool tasks too.
+ */
+void parallel_for(os_threadpool_t *tp, unsigned long first, unsigned long last,
+		unsigned long grain, void (*fn)(void *arg, unsigned long first, unsigned long last),
+		void *arg)
+{
+	parallel_for_t loop = { .fn = fn, .arg = arg, .grain = grain, .tp = tp };
+	parallel_for_range_t r = { .loop = &loop, .first = first, .last = last };
+	os_job_t job;
+
+	if (first >= last)
+		return;
+
+	if (loop.grain == 0)
+		loop.grain = (last - first) / (tp->num_threads * OS_PARALLEL_FOR_CHUNKS_PER_THREAD);
+	if (loop.grain == 0)
+		loop.grain = 1;
+
+	job_init(&job);
+	enqueue_job_task(tp, &job, create_task_copy(parallel_for_function, &r, sizeof(r)));
+	wait_for_job(tp, &job);
+	job_destroy(&job);
+}
+
+/*
+ * Create a new threadpool. Under a 'pin' policy other than OS_PIN_NONE,
+ * each thread starts on the CPUs affinity_worker_cpus() gives for it, so
+ * that the memory it touches first is local to it.
+ */
+os_threadpool_t *create_threadpool(unsigned int num_threads, os_sched_policy_t policy,
+		os_pin_policy_t pin)
 {
 	os_threadpool_t *tp = NULL;
+	pthread_attr_t attr;
+	cpu_set_t cpus;
 	int rc;
 
 	tp = malloc(sizeof(*tp));
@@ -142,7 +688,11 @@ os_threadpool_t *create_threadpool(unsigned int num_threads)
 
 	/* Initialize synchronization data. */
 	tp->shutdown = 0;
-	tp->queued_tasks = 0;
+	atomic_init(&tp->unfinished_tasks, 0);
+	tp->policy = policy;
+	atomic_init(&tp->pending_tasks, 0);
+	atomic_init(&tp->global_tasks, 0);
+	atomic_init(&tp->idle_threads, 0);
 	pthread_mutex_init(&tp->task_lock, NULL);
 	pthread_cond_init(&tp->task_cond, NULL);
 	pthread_cond_init(&tp->finished_tasks_cond, NULL);
@@ -151,20 +701,45 @@ os_threadpool_t *create_threadpool(unsigned int num_threads)
 	tp->num_threads = num_threads;
 	tp->threads = malloc(num_threads * sizeof(*tp->threads));
 	DIE(tp->threads == NULL, "malloc");
+
+	tp->workers = aligned_alloc(OS_CACHELINE_SIZE, num_threads * sizeof(*tp->workers));
+	DIE(tp->workers == NULL, "aligned_alloc");
+	tp->stats = aligned_alloc(OS_CACHELINE_SIZE, (num_threads + 1) * sizeof(*tp->stats));
+	DIE(tp->stats == NULL, "aligned_alloc");
+	memset(tp->stats, 0, (num_threads + 1) * sizeof(*tp->stats));
+	tp->start_ns = timer_now_ns();
+	atomic_init(&tp->trace, NULL);
+	for (unsigned int i = 0; i < num_threads; ++i) {
+		tp->workers[i].tp = tp;
+		tp->workers[i].id = i;
+		tp->workers[i].seed = 2654435761u * (i + 1);
+		deque_init(&tp->workers[i].deque, DEQUE_INITIAL_SIZE);
+	}
+
 	for (unsigned int i = 0; i < num_threads; ++i) {
-		rc = pthread_create(&tp->threads[i], NULL, &thread_loop_function, (void *) tp);
-		DIE(rc < 0, "pthread_create");
+		rc = pthread_attr_init(&attr);
+		DIE(rc != 0, "pthread_attr_init");
+		if (affinity_worker_cpus(pin, i, &cpus) == 0) {
+			rc = pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+			DIE(rc != 0, "pthread_attr_setaffinity_np");
+		}
+
+		rc = pthread_create(&tp->threads[i], &attr, &thread_loop_function, (void *) &tp->workers[i]);
+		DIE(rc != 0, "pthread_create");
+		pthread_attr_destroy(&attr);
 	}
 
 	return tp;
 }
 
-/* Destroy a threadpool. Assume all threads have been joined. */
+/* Destroy a threadpool, shutting it down first if that was not done yet. */
 void destroy_threadpool(os_threadpool_t *tp)
 {
 	if (tp == NULL)
 		return;
 
+	shutdown_threadpool(tp);
+
 	pthread_mutex_destroy(&tp->task_lock);
 	pthread_cond_destroy(&tp->task_cond);
 
@@ -180,6 +755,17 @@ void destroy_threadpool(os_threadpool_t *tp)
 		destroy_task(list_entry(n, os_task_t, list));
 	}
 
+	for (unsigned int i = 0; i < tp->num_threads; i++) {
+		os_task_t *t;
+
+		while ((t = deque_take(&tp->workers[i].deque)) != NULL)
+			destroy_task(t);
+		deque_destroy(&tp->workers[i].deque);
+	}
+
+	trace_destroy(atomic_load(&tp->trace));
+	free(tp->stats);
+	free(tp->workers);
 	free(tp->threads);
 	free(tp);
 }
@@ -4,26 +4,115 @@
 #define __OS_THREADPOOL_H__ 1
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include "os_list.h"
+#include "os_deque.h"
+#include "os_affinity.h"
+
+#define OS_CACHELINE_SIZE	64
+
+struct os_trace;
+
+/* Per-thread counters (see os_stats.h). Build with -DOS_STATS=0 to leave them out. */
+#ifndef OS_STATS
+#define OS_STATS	1
+#endif
+
+/*
+ * How long a thread waiting for a job sleeps, when it finds nothing to
+ * run, before looking for tasks again.
+ */
+#define OS_JOB_HELP_SLEEP_NS	50000
+
+/* Ranges parallel_for() splits its loop into, per thread, with an automatic grain. */
+#define OS_PARALLEL_FOR_CHUNKS_PER_THREAD	8
+
+/* Size of the argument buffer embedded in every task. */
+#define OS_TASK_INLINE_ARG_SIZE	32
+
+/*
+ * Job: a handle on a set of tasks (a task group), to wait for them only.
+ * Tasks enqueued while running a task of a job join that job too, so
+ * waiting for a job waits for all the work it spawned.
+ * The same job may be reused once waited for. Jobs nest: a task may wait
+ * for a job of its own, as the waiting thread runs tasks meanwhile.
+ */
+typedef struct os_job {
+	atomic_int pending; // Tasks of the job not finished yet
+	pthread_mutex_t lock;
+	pthread_cond_t cond; // Signaled when 'pending' drops to 0
+} os_job_t;
 
 /* Task structure for the threadpool. */
 typedef struct {
 	void *argument; // Pointer to the argument of the task
 	void (*action)(void *arg); // Function pointer to the task function
 	void (*destroy_arg)(void *arg); // Function pointer to a function to clean up the argument
-	os_list_node_t list; // List node to link this task in a queue
+	os_list_node_t list; // List node to link this task in a queue (or a free list)
+	os_job_t *job; // Job the task belongs to, if any
+
+	/* Storage for small arguments copied in by create_task_copy(). */
+	unsigned char inline_arg[OS_TASK_INLINE_ARG_SIZE] __attribute__((aligned(16)));
 } os_task_t;
 
+/* Scheduling policies. */
+typedef enum {
+	OS_SCHED_SHARED_QUEUE, // All threads use the single mutex-protected queue
+	OS_SCHED_WORK_STEALING // Per-thread deques, idle threads steal from random victims
+} os_sched_policy_t;
+
+/*
+ * Per-thread counters, on their own cache line. Each thread only updates
+ * its own, without synchronization; others read them as they are.
+ */
+typedef struct os_worker_stats {
+	unsigned long tasks; // Tasks run
+	unsigned long busy_ns; // Time spent running tasks
+	unsigned long idle_ns; // Time spent waiting on 'task_cond'
+	unsigned long wakeups; // Returns from waiting on 'task_cond'
+	unsigned long lock_waits; // Times 'task_lock' was found taken
+	unsigned long lock_wait_ns; // Time spent waiting for 'task_lock' then
+	unsigned long steals; // Tasks stolen from other threads
+	unsigned long steal_attempts; // Deques looked into for that, steals included
+	unsigned long max_queue_depth; // Most tasks seen in a queue after enqueueing one
+} __attribute__((aligned(OS_CACHELINE_SIZE))) os_worker_stats_t;
+
+/* Per-thread state, kept on its own cache line. */
+typedef struct os_worker {
+	struct os_threadpool *tp; // Threadpool the thread belongs to
+	unsigned int id; // Index of the thread in the threadpool
+
+	/*
+	 * Work-stealing policy only. Tasks enqueued by this thread are pushed
+	 * to and taken from the bottom of 'deque'; other threads steal from
+	 * its top.
+	 */
+	os_deque_t deque;
+	unsigned int seed; // State of the victim selection generator
+} __attribute__((aligned(OS_CACHELINE_SIZE))) os_worker_t;
+
 /* Threadpool structure. */
 typedef struct os_threadpool {
 	unsigned int num_threads; // Number of threads in the threadpool
 	pthread_t *threads; // Array of thread IDs
+	os_worker_t *workers; // Array of per-thread state
+	os_sched_policy_t policy; // Scheduling policy
+
+	/*
+	 * Counters of each thread, then a last slot shared by the threads
+	 * outside the threadpool, which should be one at a time.
+	 */
+	os_worker_stats_t *stats;
+	unsigned long start_ns; // Creation time, for the counters
+	_Atomic(struct os_trace *) trace; // Event rings, one per counter slot (see os_trace.h)
 
 	/*
 	 * Head of the task queue. 
 	 * The queue is implemented as a doubly-linked list.
 	 * 'head.next' points to the first task, if the queue is not empty.
 	 * 'head.prev' points to the last task, if the queue is not empty.
+	 * With the work-stealing policy, it only holds tasks enqueued by
+	 * threads outside the threadpool.
 	 */
 	os_list_node_t head;
 
@@ -33,20 +122,42 @@ typedef struct os_threadpool {
 	pthread_mutex_t task_lock; // Mutex for synchronizing access to the task queue
 	pthread_cond_t task_cond; // Condition variable for task availability
 
-	int queued_tasks; // Counter for the number of tasks currently queued
+	atomic_int pending_tasks; // Tasks enqueued, but not dequeued yet
+
+	/* Work-stealing policy only. */
+	atomic_int global_tasks; // Tasks in the 'head' queue
+	atomic_int idle_threads; // Threads waiting on 'task_cond'
+
+	atomic_int unfinished_tasks; // Tasks enqueued, but not finished yet
 	pthread_mutex_t finished_tasks_mutex; // Mutex for synchronizing the completion of tasks
 	pthread_cond_t finished_tasks_cond; // Condition variable for task completion
 } os_threadpool_t;
 
 /* Function declarations. */
 os_task_t *create_task(void (*f)(void *), void *arg, void (*destroy_arg)(void *));
+os_task_t *create_task_copy(void (*f)(void *), const void *arg, size_t size);
+os_task_t *create_task_sized(void (*f)(void *), size_t size);
 void destroy_task(os_task_t *t);
 
-os_threadpool_t *create_threadpool(unsigned int num_threads);
+os_threadpool_t *create_threadpool(unsigned int num_threads, os_sched_policy_t policy,
+		os_pin_policy_t pin);
+void shutdown_threadpool(os_threadpool_t *tp);
 void destroy_threadpool(os_threadpool_t *tp);
 
 void enqueue_task(os_threadpool_t *q, os_task_t *t);
 os_task_t *dequeue_task(os_threadpool_t *tp);
 void wait_for_completion(os_threadpool_t *tp);
 
+void job_init(os_job_t *job);
+void job_destroy(os_job_t *job);
+void enqueue_job_task(os_threadpool_t *tp, os_job_t *job, os_task_t *t);
+void wait_for_job(os_threadpool_t *tp, os_job_t *job);
+
+void parallel_for(os_threadpool_t *tp, unsigned long first, unsigned long last,
+		unsigned long grain, void (*fn)(void *arg, unsigned long first, unsigned long last),
+		void *arg);
+
+unsigned int threadpool_worker_id(os_threadpool_t *tp);
+unsigned int threadpool_queue_depth(os_threadpool_t *tp);
+
 #endif /* __OS_THREADPOOL_H__ */
@@ -0,0 +1,52 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Phase timing, reported with -T by serial and parallel as one line on
+ * stderr, for tests/bench.py to parse:
+ *
+ *   phases: load=<s> build=<s> traverse=<s>
+ *
+ * 'load' is reading and parsing (or mapping) the input, 'build' turning
+ * the parsed edges into CSR (0 for binary graphs), and 'traverse' running
+ * the selected algorithm, printing excluded.
+ */
+
+#ifndef __OS_TIMER_H__
+#define __OS_TIMER_H__	1
+
+#include <stdio.h>
+#include <time.h>
+
+typedef struct os_phase_times {
+	double load;
+	double build;
+	double traverse;
+} os_phase_times_t;
+
+/* Monotonic time, in seconds. */
+static inline double timer_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Monotonic time, in nanoseconds. */
+static inline unsigned long timer_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static inline void print_phase_times(const os_phase_times_t *t)
+{
+	fprintf(stderr, "phases: load=%.6f build=%.6f traverse=%.6f\n",
+			t->load, t->build, t->traverse);
+}
+
+#endif
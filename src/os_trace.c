@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dlfcn.h>
+
+#include "os_trace.h"
+#include "log/log.h"
+#include "utils.h"
+
+/* Trace-event names and phases ('B'egin, 'E'nd, 'i'nstant) of each event type. */
+static const struct {
+	const char *name;
+	char phase;
+} trace_kinds[] = {
+	[TRACE_TASK_BEGIN] = { "task", 'B' },
+	[TRACE_TASK_END] = { "task", 'E' },
+	[TRACE_ENQUEUE] = { "enqueue", 'i' },
+	[TRACE_IDLE_BEGIN] = { "idle", 'B' },
+	[TRACE_IDLE_END] = { "idle", 'E' },
+	[TRACE_LOCK_BEGIN] = { "lock wait", 'B' },
+	[TRACE_LOCK_END] = { "lock wait", 'E' },
+};
+
+/*
+ * Start recording events in 'tp', for its threads and for one thread
+ * outside it. Doing it again does nothing.
+ */
+void trace_start(os_threadpool_t *tp)
+{
+	unsigned int num_rings = tp->num_threads + 1;
+	os_trace_t *trace;
+
+	if (atomic_load(&tp->trace) != NULL)
+		return;
+
+	trace = aligned_alloc(OS_CACHELINE_SIZE,
+			sizeof(*trace) + num_rings * sizeof(trace->rings[0]));
+	DIE(trace == NULL, "aligned_alloc");
+
+	trace->num_rings = num_rings;
+	for (unsigned int i = 0; i < num_rings; i++) {
+		trace->rings[i].events = malloc(TRACE_RING_EVENTS * sizeof(os_trace_event_t));
+		DIE(trace->rings[i].events == NULL, "malloc");
+		trace->rings[i].count = 0;
+	}
+	trace->start = trace_clock();
+
+	atomic_store_explicit(&tp->trace, trace, memory_order_release);
+}
+
+void trace_destroy(os_trace_t *trace)
+{
+	if (trace == NULL)
+		return;
+
+	for (unsigned int i = 0; i < trace->num_rings; i++)
+		free(trace->rings[i].events);
+	free(trace);
+}
+
+/*
+ * Name a task function: its symbol if exported, otherwise its offset in
+ * its object file, for addr2line -f -e <file> <offset>.
+ */
+static void write_function(FILE *f, unsigned long addr)
+{
+	const char *file;
+	Dl_info info;
+
+	if (dladdr((void *) addr, &info) == 0 || info.dli_fname == NULL)
+		fprintf(f, "\"%#lx\"", addr);
+	else if (info.dli_sname != NULL && info.dli_saddr == (void *) addr)
+		fprintf(f, "\"%s\"", info.dli_sname);
+	else {
+		file = strrchr(info.dli_fname, '/');
+		fprintf(f, "\"%s+%#lx\"", file != NULL ? file + 1 : info.dli_fname,
+				addr - (unsigned long) info.dli_fbase);
+	}
+}
+
+/*
+ * Write the events of ring 'ring'. When the ring wrapped around, the ends
+ * of spans whose begin was overwritten are left out.
+ */
+static void write_ring(FILE *f, os_trace_t *trace, unsigned int ring, int pid)
+{
+	os_trace_ring_t *r = &trace->rings[ring];
+	unsigned long first = r->count > TRACE_RING_EVENTS ? r->count - TRACE_RING_EVENTS : 0;
+	unsigned int depth = 0;
+
+	if (first > 0)
+		log_warn("Trace of thread %u: %lu oldest events overwritten", ring, first);
+
+	for (unsigned long i = first; i < r->count; i++) {
+		os_trace_event_t *e = &r->events[i & (TRACE_RING_EVENTS - 1)];
+		char phase = trace_kinds[e->type].phase;
+
+		if (phase == 'E' && depth == 0)
+			continue;
+		depth += phase == 'B' ? 1 : phase == 'E' ? -1 : 0;
+
+		fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"%c\", \"pid\": %d, \"tid\": %u, \"ts\": %.3f",
+				trace_kinds[e->type].name, phase, pid, ring, (e->ts - trace->start) / 1e3);
+		if (e->type == TRACE_TASK_BEGIN) {
+			fprintf(f, ", \"args\": {\"fn\": ");
+			write_function(f, e->data);
+			fprintf(f, "}");
+		} else if (e->type == TRACE_ENQUEUE)
+			fprintf(f, ", \"s\": \"t\", \"args\": {\"depth\": %lu}", e->data);
+		fprintf(f, "}");
+	}
+}
+
+/*
+ * Write the trace of 'tp' to 'path' as a Chrome trace-event JSON file.
+ * The threadpool must have been shut down, and the thread outside it
+ * that was traced must be the calling one.
+ */
+int trace_write(os_threadpool_t *tp, const char *path)
+{
+	os_trace_t *trace = atomic_load(&tp->trace);
+	int pid = getpid();
+	FILE *f;
+
+	if (trace == NULL)
+		return 0;
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		log_error("Can't open %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+	fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"threadpool\"}}",
+			pid);
+	for (unsigned int i = 0; i < trace->num_rings; i++) {
+		fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %u, ", pid, i);
+		if (i < tp->num_threads)
+			fprintf(f, "\"args\": {\"name\": \"worker %u\"}}", i);
+		else
+			fprintf(f, "\"args\": {\"name\": \"outside\"}}");
+	}
+	for (unsigned int i = 0; i < trace->num_rings; i++)
+		write_ring(f, trace, i, pid);
+	fprintf(f, "\n]}\n");
+
+	if (fclose(f) != 0) {
+		log_error("Can't write %s: %s", path, strerror(errno));
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,81 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Timeline of the threadpool, in the Chrome trace-event format that
+ * chrome://tracing and Perfetto (ui.perfetto.dev) load.
+ *
+ * Once trace_start() is called, every thread records when it runs tasks,
+ * enqueues, waits for 'task_lock' and sleeps waiting for work. Events go
+ * to a ring of the thread's own, the same slot as its counters (see
+ * os_worker_stats_t), so recording takes neither a lock nor an atomic
+ * operation. A full ring overwrites its oldest events. trace_write()
+ * writes all rings out, once the threadpool is shut down.
+ */
+
+#ifndef __OS_TRACE_H__
+#define __OS_TRACE_H__	1
+
+#include <time.h>
+
+#include "os_threadpool.h"
+
+/* Events kept per thread, a power of two. */
+#define TRACE_RING_EVENTS	(1UL << 18)
+
+typedef enum {
+	TRACE_TASK_BEGIN, // 'data' is the task function
+	TRACE_TASK_END,
+	TRACE_ENQUEUE, // 'data' is the queue depth after enqueueing
+	TRACE_IDLE_BEGIN, // Waiting on 'task_cond'
+	TRACE_IDLE_END,
+	TRACE_LOCK_BEGIN, // Waiting for 'task_lock', found taken
+	TRACE_LOCK_END
+} os_trace_event_type_t;
+
+typedef struct os_trace_event {
+	unsigned long ts; // See trace_clock()
+	unsigned long data;
+	unsigned int type;
+} os_trace_event_t;
+
+typedef struct os_trace_ring {
+	os_trace_event_t *events;
+	unsigned long count; // Events ever recorded, the last TRACE_RING_EVENTS are kept
+} __attribute__((aligned(OS_CACHELINE_SIZE))) os_trace_ring_t;
+
+typedef struct os_trace {
+	unsigned long start; // trace_clock() at trace_start()
+	unsigned int num_rings;
+	os_trace_ring_t rings[];
+} os_trace_t;
+
+/*
+ * Trace time, in nanoseconds. CLOCK_MONOTONIC_RAW is read through the
+ * vDSO, without a system call, and is not slewed by NTP.
+ */
+static inline unsigned long trace_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* Record an event in ring 'ring'. Only the thread owning the ring may do so. */
+static inline void trace_event(os_trace_t *trace, unsigned int ring, os_trace_event_type_t type,
+		unsigned long data)
+{
+	os_trace_ring_t *r = &trace->rings[ring];
+	os_trace_event_t *e = &r->events[r->count++ & (TRACE_RING_EVENTS - 1)];
+
+	e->ts = trace_clock();
+	e->data = data;
+	e->type = type;
+}
+
+void trace_start(os_threadpool_t *tp);
+int trace_write(os_threadpool_t *tp, const char *path);
+void trace_destroy(os_trace_t *trace);
+
+#endif
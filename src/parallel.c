@@ -2,166 +2,582 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <sys/types.h>
-#include <time.h>
 
 #include "os_graph.h"
+#include "os_graph_bin.h"
+#include "os_graph_build.h"
+#include "os_graph_order.h"
+#include "os_graph_compress.h"
+#include "os_graph_update.h"
+#include "os_graph_stream.h"
+#include "os_bfs.h"
+#include "os_cc.h"
+#include "os_sssp.h"
+#include "os_pagerank.h"
 #include "os_threadpool.h"
+#include "os_task_pool.h"
+#include "os_stats.h"
+#include "os_trace.h"
+#include "os_timer.h"
 #include "log/log.h"
 #include "utils.h"
 
-#define NUM_THREADS		4
+/* Thread count, unless given with -t: the CPUs available by default. */
+#define NUM_THREADS_ENV		"OS_NUM_THREADS"
+#define MAX_THREADS		1024
 
-static int sum; // Global variable to store the sum of all nodes.
+/* With -S, the threadpool counters are also written out on this signal. */
+#define STATS_SIGNAL		SIGUSR1
+
+/* What to compute, chosen with -m. */
+typedef enum {
+	MODE_SUM,
+	MODE_COMPONENTS,
+	MODE_SSSP,
+	MODE_PAGERANK
+} run_mode_t;
+
+static long long sum; // Global variable to store the sum of all nodes.
 static os_graph_t *graph; // Pointer to the graph
 static os_threadpool_t *tp; // Pointer to the threadpool
+static os_phase_times_t times; // Reported with -T
+
+/*
+ * Per-thread partial sums, each on its own cache line, so that threads
+ * never write to shared memory to add a node. Indexed by
+ * threadpool_worker_id() and added up into 'sum' once all tasks are done.
+ */
+typedef struct {
+	long long sum;
+} __attribute__((aligned(OS_CACHELINE_SIZE))) partial_sum_t;
 
-/* Define graph synchronization mechanisms. */
-pthread_mutex_t sum_lock; // Mutex for accesing the sum variable.
-pthread_mutex_t *visit_locks; // Mutex for accesing the visited array.
+static partial_sum_t *partial_sums;
+
+/*
+ * Task granularity. Each task processes the nodes it discovers from a
+ * local worklist, and hands 'chunk_size' of them to a new task whenever
+ * the worklist holds twice that many. With 0, handoffs adapt to the queue
+ * depth instead: while fewer tasks than threads are queued, half of the
+ * worklist is handed off, so that idle threads get work; otherwise the
+ * nodes are kept local, up to ADAPTIVE_WORKLIST_SIZE.
+ */
+#define MAX_CHUNK_SIZE		4096
+#define ADAPTIVE_WORKLIST_SIZE	256
+
+static unsigned int chunk_size; // Nodes per task handoff, 0 for adaptive
 
 /* Structure to hold arguments for graph node processing task. */
 typedef struct {
-	int index;
+	unsigned int count; // Number of (already claimed) nodes to process
+	unsigned int nodes[];
 } process_node_t;
 
-void os_destroy_arg(void *arg)
+/*
+ * Claim node 'idx' by moving it from NOT_VISITED to PROCESSING.
+ * Return 1 if the calling thread won the node and must process it.
+ * The 'visited' array is shared with the serial code as a plain array,
+ * hence the GCC atomic builtins instead of <stdatomic.h>.
+ */
+static int claim_node(unsigned int idx)
 {
-	process_node_t *tmp = (process_node_t *) arg;
+	typeof(*graph->visited) expected = NOT_VISITED;
+
+	/* Cheap check first, most neighbours are visited already. */
+	if (__atomic_load_n(&graph->visited[idx], __ATOMIC_RELAXED) != NOT_VISITED)
+		return 0;
+
+	return __atomic_compare_exchange_n(&graph->visited[idx], &expected, PROCESSING, 0,
+			__ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+}
+
+void process_node_function(void *arg);
+
+/* Set up a task processing 'count' claimed nodes. */
+static os_task_t *create_nodes_task(const unsigned int *nodes, unsigned int count)
+{
+	os_task_t *task;
+	process_node_t *tmp;
+
+	task = create_task_sized(process_node_function, sizeof(*tmp) + count * sizeof(*nodes));
+	tmp = (process_node_t *) task->argument;
+	tmp->count = count;
+	memcpy(tmp->nodes, nodes, count * sizeof(*nodes));
+
+	return task;
+}
 
-	free(tmp); // Free the memory allocated for the task argument
+/* Hand 'count' claimed nodes over to a new task, part of the current job. */
+static void submit_nodes(const unsigned int *nodes, unsigned int count)
+{
+	enqueue_task(tp, create_nodes_task(nodes, count));
 }
 
 void process_node_function(void *arg)
 {
 	process_node_t *tmp = (process_node_t *) arg;
-	int index = tmp->index;
+	partial_sum_t *partial = &partial_sums[threadpool_worker_id(tp)];
+	unsigned int limit = chunk_size != 0 ? 2 * chunk_size : ADAPTIVE_WORKLIST_SIZE;
+	unsigned int worklist[2 * MAX_CHUNK_SIZE];
+	unsigned int top = tmp->count;
 
-	// the actual graph node
-	os_node_t *node = graph->nodes[index];
+	memcpy(worklist, tmp->nodes, tmp->count * sizeof(*worklist));
 
-	// Lock the sum mutex, add node's value to sum, and unlock the mutex.
-	pthread_mutex_lock(&sum_lock);
-	sum += node->info;
-	pthread_mutex_unlock(&sum_lock);
+	while (top > 0) {
+		unsigned int index = worklist[--top];
 
-	// Iterate over the neighbours of the current node
-	for (unsigned int i = 0; i < node->num_neighbours; ++i) {
-		pthread_mutex_lock(&visit_locks[node->neighbours[i]]);
+		// the neighbours of the actual graph node, decoded on the fly if compressed
+		os_neighbour_iter_t it;
+		unsigned int v;
 
-		// Check if the neighbour node has not been visited
-		if (graph->visited[node->neighbours[i]] == NOT_VISITED) {
-			graph->visited[node->neighbours[i]] = PROCESSING;
+		// Add node's value to the partial sum of this thread.
+		partial->sum += graph->values[index];
 
-			// Allocate and set up the task for processing the neighbour node
-			process_node_t *tmp = (process_node_t *) malloc(sizeof(process_node_t));
+		// Iterate over the neighbours of the current node
+		graph_iter_init(&it, graph, index);
+		while (graph_iter_next(&it, v)) {
+			// Check if the neighbour node has not been visited, and claim it
+			if (!claim_node(v))
+				continue;
 
-			tmp->index = node->neighbours[i];
+			worklist[top++] = v;
+			if (top == limit) {
+				unsigned int surplus = chunk_size != 0 ? chunk_size : limit / 2;
 
-			os_task_t *task = create_task(process_node_function, (void *) tmp, os_destroy_arg);
+				top -= surplus;
+				submit_nodes(&worklist[top], surplus);
+			}
+		}
 
-			// Update the task count and enqueue the task in the thread pool
-			pthread_mutex_lock(&tp->finished_tasks_mutex);
-			++tp->queued_tasks;
-			pthread_mutex_unlock(&tp->finished_tasks_mutex);
+		__atomic_store_n(&graph->visited[index], DONE, __ATOMIC_RELEASE);
 
-			enqueue_task(tp, task);
-		}
+		// Adaptive mode: feed threads that may be out of work.
+		if (chunk_size == 0 && top > 1 && threadpool_queue_depth(tp) < tp->num_threads) {
+			unsigned int surplus = top / 2;
 
-		pthread_mutex_unlock(&visit_locks[node->neighbours[i]]);
+			top -= surplus;
+			submit_nodes(&worklist[top], surplus);
+		}
 	}
+}
+
+/*
+ * Sum up the values of the nodes reachable from 'idx' by flooding the
+ * graph with tasks, and wait for just these tasks. The threadpool stays
+ * up for further traversals.
+ */
+static long long flood_sum(unsigned int idx)
+{
+	long long total = 0;
+	os_job_t job;
 
-	// Update the graph and thread pool state
-	pthread_mutex_lock(&tp->finished_tasks_mutex);
+	memset(partial_sums, 0, (tp->num_threads + 1) * sizeof(*partial_sums));
 
-	pthread_mutex_lock(&visit_locks[index]);
-	graph->visited[index] = DONE;
-	pthread_mutex_unlock(&visit_locks[index]);
+	// Check if the current node has not been visited, and claim it
+	if (!claim_node(idx))
+		return 0;
 
-	if (--tp->queued_tasks == 0)
-		pthread_cond_signal(&tp->finished_tasks_cond); // Signal if all tasks are done
+	job_init(&job);
+	enqueue_job_task(tp, &job, create_nodes_task(&idx, 1));
+	wait_for_job(tp, &job);
+	job_destroy(&job);
 
-	pthread_mutex_unlock(&tp->finished_tasks_mutex);
+	for (unsigned int i = 0; i <= tp->num_threads; i++)
+		total += partial_sums[i].sum;
+
+	return total;
 }
 
-static void process_node(unsigned int idx)
+/*
+ * Spread the graph over the NUMA nodes. Floods and BFS levels reach the
+ * nodes in no particular order, so no placement makes them local to the
+ * workers using them; interleaving at least balances the memory traffic
+ * over all the nodes instead of loading the one the graph was read on.
+ */
+static void interleave_graph(void)
 {
-	pthread_mutex_lock(&visit_locks[idx]);
+	size_t num_nodes = graph->num_nodes;
+	size_t num_adj = graph->offsets[num_nodes];
+	int rc;
+
+	if (graph->mapping != NULL)
+		rc = affinity_interleave(graph->mapping, graph->mapping_size);
+	else if (graph->neighbours != NULL)
+		rc = affinity_interleave(graph->offsets, (num_nodes + 1) * sizeof(unsigned long)) |
+			affinity_interleave(graph->neighbours, num_adj * sizeof(unsigned int)) |
+			affinity_interleave(graph->values, num_nodes * sizeof(int));
+	else
+		rc = affinity_interleave(graph->offsets, (num_nodes + 1) * sizeof(unsigned long)) |
+			affinity_interleave(graph->values, num_nodes * sizeof(int));
+	if (graph->mapping == NULL && graph->weights != NULL)
+		rc |= affinity_interleave(graph->weights, num_adj * sizeof(unsigned int));
+	if (graph->adj != NULL)
+		rc |= affinity_interleave(graph->adj, graph->adj_offsets[num_nodes]) |
+			affinity_interleave(graph->adj_offsets, (num_nodes + 1) * sizeof(unsigned long));
+	if (graph->visited != NULL)
+		rc |= affinity_interleave(graph->visited, num_nodes * sizeof(*graph->visited));
+
+	if (rc < 0)
+		log_warn("Can't interleave the graph over the NUMA nodes: %s", strerror(errno));
+}
 
-	// Check if the current node has not been visited
-	if (graph->visited[idx] == NOT_VISITED) {
-		graph->visited[idx] = PROCESSING;
+/* build_graph_parallel(), timed as the build phase. */
+static os_graph_t *timed_build(void *ctx, unsigned int num_nodes, unsigned int num_edges,
+		int *values, os_edge_t *edges, int weighted)
+{
+	double start = timer_now();
+	os_graph_t *g;
 
-		// Allocate and set up the task for processing the current node
-		process_node_t *arg = (process_node_t *) malloc(sizeof(process_node_t));
+	g = build_graph_parallel(ctx, num_nodes, num_edges, values, edges, weighted);
+	times.build = timer_now() - start;
 
-		arg->index = idx;
+	return g;
+}
 
-		os_task_t *task = create_task(process_node_function, (void *) arg, os_destroy_arg);
+/*
+ * Load the graph from 'file', relabel and compress it as asked, timing
+ * each phase, allocate 'visited' if the traversal is to mark the nodes
+ * there, and lay it out for the placement 'pin'.
+ */
+static void load_graph(FILE *file, const char *path, os_graph_build_ctx_t *build,
+		os_graph_order_t order, int compress, int visits, os_pin_policy_t pin)
+{
+	double start;
+
+	/* Text graphs are built on the threadpool as well. */
+	build->tp = tp;
+	start = timer_now();
+	graph = create_graph_from_file_with(file, timed_build, build);
+	if (graph == NULL) {
+		log_fatal("Can't load graph from %s", path);
+		exit(EXIT_FAILURE);
+	}
+	times.load = timer_now() - start - times.build;
 
-		// Update the task count and enqueue the task in the thread pool
-		pthread_mutex_lock(&tp->finished_tasks_mutex);
-		++tp->queued_tasks;
-		pthread_mutex_unlock(&tp->finished_tasks_mutex);
+	if (order != GRAPH_ORDER_NONE) {
+		os_graph_t *reordered;
 
-		enqueue_task(tp, task);
+		start = timer_now();
+		reordered = reorder_graph(graph, order);
+		destroy_graph(graph);
+		graph = reordered;
+		times.build += timer_now() - start;
 	}
 
-	pthread_mutex_unlock(&visit_locks[idx]);
+	if (compress) {
+		start = timer_now();
+		compress_graph(graph);
+		times.build += timer_now() - start;
+	}
+
+	if (visits) {
+		start = timer_now();
+		graph_alloc_visited(graph);
+		times.build += timer_now() - start;
+	}
+
+	if (pin == OS_PIN_NUMA)
+		interleave_graph();
 }
 
-void free_graph(os_graph_t *graph)
+/*
+ * Components of the graph in 'file', streamed in chunks of 'chunk_size'
+ * bytes rather than loaded: parsing and computing them are one pass,
+ * timed as the traversal.
+ */
+static os_components_t *stream_graph(FILE *file, const char *path, size_t chunk_size)
 {
-	// Free the memory allocated for the graph
-	for (unsigned int i = 0; i < graph->num_nodes; ++i) {
-		free(graph->nodes[i]->neighbours);
-		free(graph->nodes[i]);
+	os_components_t *cc;
+
+	if (graph_file_is_binary(file)) {
+		log_fatal("%s is binary, and mapped rather than streamed: drop -R", path);
+		exit(EXIT_FAILURE);
 	}
 
-	free(graph->nodes);
-	free(graph->visited);
-	free(graph);
+	cc = stream_components(tp, file, chunk_size);
+	if (cc == NULL) {
+		log_fatal("Can't stream graph from %s", path);
+		exit(EXIT_FAILURE);
+	}
+
+	return cc;
+}
+
+/* Parse a thread count. Return 0 if 'str' is not a valid one. */
+static unsigned int parse_num_threads(const char *str)
+{
+	unsigned long n;
+	char *end;
+
+	n = strtoul(str, &end, 10);
+	if (*str == '\0' || *end != '\0' || n > MAX_THREADS)
+		return 0;
+
+	return n;
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-T] [-t num_threads] [-p none|cores|numa] [-d] [-m sum|components|sssp|pagerank] [-s shared|steal] [-e flood|bfs] [-c chunk_size] [-D delta] [-i iterations] [-o none|degree|bfs|rcm] [-z] [-u updates_file] [-R chunk_kib] [-S stats_file] [-x trace_file] input_file\n",
+			argv0);
+	fprintf(stderr, "  -T  print the time of each phase to stderr\n");
+	fprintf(stderr, "  -t  number of threads, up to %d (default: $%s, or the CPUs available)\n",
+			MAX_THREADS, NUM_THREADS_ENV);
+	fprintf(stderr, "  -p  thread placement: none (default), one core per thread, or spread over the\n"
+			"      NUMA nodes with the graph interleaved across them\n");
+	fprintf(stderr, "  -d  drop self-loops and duplicate edges from text graphs\n");
+	fprintf(stderr, "  -m  sum of the component of node 0 (default), all components, the shortest\n"
+			"      path distances from node 0 (delta-stepping), or the PageRank of all nodes\n");
+	fprintf(stderr, "  -s  scheduling policy: one shared queue or work stealing (default)\n");
+	fprintf(stderr, "  -e  traversal engine: tasks flooding the graph (default) or level-synchronous BFS\n");
+	fprintf(stderr, "  -c  nodes per task handoff for flood, up to %d; 0 adapts to the queue depth (default)\n",
+			MAX_CHUNK_SIZE);
+	fprintf(stderr, "  -D  bucket width for sssp (default: the mean edge weight); much below the\n"
+			"      edge weights, it makes many buckets\n");
+	fprintf(stderr, "  -i  PageRank iterations at most (default: %d)\n", GRAPH_PAGERANK_ITERATIONS);
+	fprintf(stderr, "  -o  relabel the nodes for locality first, timed as part of the build\n");
+	fprintf(stderr, "  -z  compress the adjacency, then decode it while traversing\n");
+	fprintf(stderr, "  -u  then apply the batches of updates_file (see os_graph_update.h), printing\n"
+			"      the sum after each, or the components after the last one\n");
+	fprintf(stderr, "  -R  stream the text graph in chunks of chunk_kib KiB (0: %lu) instead of loading it,\n"
+			"      keeping only per-node state in memory; sum and components modes only\n",
+			STREAM_CHUNK_SIZE >> 10);
+	fprintf(stderr, "  -S  write the threadpool counters as JSON to stats_file ('-' for stderr) at exit,\n"
+			"      and on SIGUSR1 while running\n");
+	fprintf(stderr, "  -x  record a timeline of the threadpool to trace_file, in Chrome trace-event format\n");
+	exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
 {
+	os_sched_policy_t policy = OS_SCHED_WORK_STEALING;
+	os_pin_policy_t pin = OS_PIN_NONE;
+	unsigned int num_threads = 0;
+	const char *env;
+	os_graph_build_ctx_t build = { .flags = 0 };
+	os_graph_order_t order = GRAPH_ORDER_NONE;
+	int compress = 0;
+	os_components_t *cc = NULL;
+	unsigned long *dist = NULL;
+	unsigned long delta = 0;
+	double *rank = NULL;
+	unsigned int iterations = GRAPH_PAGERANK_ITERATIONS;
+	run_mode_t mode = MODE_SUM;
+	int use_bfs = 0;
+	int print_times = 0;
+	const char *stats_path = NULL;
+	const char *trace_path = NULL;
 	FILE *input_file;
+	FILE *updates_file = NULL;
+	size_t stream_chunk = 0;
+	int stream = 0;
+	double start;
+	char *end;
+	int opt;
+
+	env = getenv(NUM_THREADS_ENV);
+	if (env != NULL) {
+		num_threads = parse_num_threads(env);
+		if (num_threads == 0) {
+			log_fatal("Invalid %s: %s", NUM_THREADS_ENV, env);
+			exit(EXIT_FAILURE);
+		}
+	}
 
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s input_file\n", argv[0]);
-		exit(EXIT_FAILURE);
+	while ((opt = getopt(argc, argv, "Tt:p:dm:s:e:c:D:i:o:zS:x:u:R:")) != -1) {
+		switch (opt) {
+		case 'T':
+			print_times = 1;
+			break;
+		case 't':
+			num_threads = parse_num_threads(optarg);
+			if (num_threads == 0)
+				usage(argv[0]);
+			break;
+		case 'p':
+			if (strcmp(optarg, "none") == 0)
+				pin = OS_PIN_NONE;
+			else if (strcmp(optarg, "cores") == 0)
+				pin = OS_PIN_CORES;
+			else if (strcmp(optarg, "numa") == 0)
+				pin = OS_PIN_NUMA;
+			else
+				usage(argv[0]);
+			break;
+		case 'd':
+			build.flags |= GRAPH_BUILD_SIMPLE;
+			break;
+		case 'm':
+			if (strcmp(optarg, "sum") == 0)
+				mode = MODE_SUM;
+			else if (strcmp(optarg, "components") == 0)
+				mode = MODE_COMPONENTS;
+			else if (strcmp(optarg, "sssp") == 0)
+				mode = MODE_SSSP;
+			else if (strcmp(optarg, "pagerank") == 0)
+				mode = MODE_PAGERANK;
+			else
+				usage(argv[0]);
+			break;
+		case 's':
+			if (strcmp(optarg, "shared") == 0)
+				policy = OS_SCHED_SHARED_QUEUE;
+			else if (strcmp(optarg, "steal") == 0)
+				policy = OS_SCHED_WORK_STEALING;
+			else
+				usage(argv[0]);
+			break;
+		case 'e':
+			if (strcmp(optarg, "flood") == 0)
+				use_bfs = 0;
+			else if (strcmp(optarg, "bfs") == 0)
+				use_bfs = 1;
+			else
+				usage(argv[0]);
+			break;
+		case 'c':
+			chunk_size = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *end != '\0' || chunk_size > MAX_CHUNK_SIZE)
+				usage(argv[0]);
+			break;
+		case 'D':
+			delta = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *optarg == '-' || *end != '\0' || delta == 0)
+				usage(argv[0]);
+			break;
+		case 'i':
+			iterations = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *optarg == '-' || *end != '\0' || iterations == 0)
+				usage(argv[0]);
+			break;
+		case 'o':
+			if (parse_graph_order(optarg, &order) < 0)
+				usage(argv[0]);
+			break;
+		case 'z':
+			compress = 1;
+			break;
+		case 'R':
+			/* In KiB, and stream_components() allocates two chunks each. */
+			stream_chunk = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *optarg == '-' || *end != '\0' ||
+					stream_chunk > SIZE_MAX >> 11)
+				usage(argv[0]);
+			stream_chunk <<= 10;
+			stream = 1;
+			break;
+		case 'u':
+			updates_file = fopen(optarg, "r");
+			DIE(updates_file == NULL, "fopen");
+			break;
+		case 'S':
+			stats_path = optarg;
+			break;
+		case 'x':
+			trace_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
 	}
 
-	input_file = fopen(argv[1], "r");
+	if (argc - optind != 1)
+		usage(argv[0]);
+	if (updates_file != NULL && mode != MODE_SUM && mode != MODE_COMPONENTS)
+		usage(argv[0]);
+	if (stream && ((mode != MODE_SUM && mode != MODE_COMPONENTS) || updates_file != NULL ||
+			order != GRAPH_ORDER_NONE || compress))
+		usage(argv[0]);
+
+	input_file = fopen(argv[optind], "r");
 	DIE(input_file == NULL, "fopen");
 
-	graph = create_graph_from_file(input_file);
+	if (num_threads == 0)
+		num_threads = affinity_num_cpus();
+	if (num_threads > MAX_THREADS)
+		num_threads = MAX_THREADS;
 
 	/* Initialize graph synchronization mechanisms. */
-	tp = create_threadpool(NUM_THREADS);
-
-	pthread_mutex_init(&sum_lock, NULL);
-
-	visit_locks = (pthread_mutex_t *) malloc(graph->num_nodes * sizeof(pthread_mutex_t));
-	for (unsigned int i = 0; i < graph->num_nodes; ++i)
-		pthread_mutex_init(&visit_locks[i], NULL);
-
-	process_node(0);
+	if (stats_path != NULL)
+		stats_signal_block(STATS_SIGNAL);
+	tp = create_threadpool(num_threads, policy, pin);
+	if (stats_path != NULL)
+		stats_signal_start(tp, STATS_SIGNAL, stats_path);
+	if (trace_path != NULL)
+		trace_start(tp);
+
+	if (!stream)
+		/* Only the sum traversals, flood and bfs, mark the nodes visited. */
+		load_graph(input_file, argv[optind], &build, order, compress,
+				mode == MODE_SUM && updates_file == NULL, pin);
+
+	partial_sums = aligned_alloc(OS_CACHELINE_SIZE,
+			(tp->num_threads + 1) * sizeof(*partial_sums));
+	DIE(partial_sums == NULL, "aligned_alloc");
+
+	start = timer_now();
+	if (stream)
+		cc = stream_graph(input_file, argv[optind], stream_chunk);
+	else if (mode == MODE_COMPONENTS || updates_file != NULL)
+		cc = components_to_input(graph, cc_label(tp, graph));
+	else if (mode == MODE_SSSP)
+		dist = sssp_delta_stepping(tp, graph, graph_node_from_input(graph, 0), delta);
+	else if (mode == MODE_PAGERANK)
+		rank = pagerank(tp, graph, iterations);
+	else if (use_bfs)
+		sum = bfs_sum(tp, graph, graph_node_from_input(graph, 0));
+	else
+		sum = flood_sum(graph_node_from_input(graph, 0));
+	times.traverse = timer_now() - start;
+
+	/* Streamed graphs give the sum as the component of node 0. */
+	if (stream && mode == MODE_SUM) {
+		sum = cc->num_nodes != 0 ? cc->sum[cc->label[0]] : 0;
+		destroy_components(cc);
+		cc = NULL;
+	}
 
-	wait_for_completion(tp);
+	shutdown_threadpool(tp);
+	if (stats_path != NULL) {
+		stats_signal_stop();
+		stats_dump(tp, stats_path);
+	}
+	if (trace_path != NULL)
+		trace_write(tp, trace_path);
 	destroy_threadpool(tp);
+	task_pool_cleanup();
+
+	if (updates_file != NULL) {
+		os_dynamic_graph_t *dg = create_dynamic_graph(graph, cc);
+
+		if (replay_updates(dg, updates_file, mode == MODE_SUM) < 0)
+			exit(EXIT_FAILURE);
+		destroy_dynamic_graph(dg);
+		fclose(updates_file);
+	} else if (cc != NULL) {
+		print_components(cc);
+		destroy_components(cc);
+	} else if (dist != NULL) {
+		print_distances(graph, dist);
+		free(dist);
+	} else if (rank != NULL) {
+		print_ranks(graph, rank);
+		free(rank);
+	} else {
+		printf("%lld", sum);
+	}
 
-	pthread_mutex_destroy(&sum_lock);
-
-	visit_locks = (pthread_mutex_t *) malloc(graph->num_nodes * sizeof(pthread_mutex_t));
-	for (unsigned int i = 0; i < graph->num_nodes; ++i)
-		pthread_mutex_destroy(&visit_locks[i]);
+	if (print_times)
+		print_phase_times(&times);
 
-	printf("%d", sum);
+	free(partial_sums);
 
-	free(visit_locks);
-	free_graph(graph);
+	destroy_graph(graph);
 	fclose(input_file);
 
 	return 0;
@@ -2,44 +2,454 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "os_graph.h"
+#include "os_graph_order.h"
+#include "os_graph_compress.h"
+#include "os_graph_update.h"
+#include "os_timer.h"
 #include "log/log.h"
 #include "utils.h"
 
-static int sum;
+/* How many neighbours ahead the visited bits of plain lists are prefetched. */
+#define PREFETCH_DISTANCE	16
+
+/* What to compute, chosen with -m. */
+typedef enum {
+	MODE_SUM,
+	MODE_COMPONENTS,
+	MODE_SSSP,
+	MODE_PAGERANK
+} run_mode_t;
+
+static long long sum;
 static os_graph_t *graph;
+static os_phase_times_t times;
+
+/* Traversal state: nodes found but not processed yet, and nodes ever found. */
+static unsigned int *queue;
+static unsigned int head, tail;
+static uint64_t *visited;
+
+/*
+ * Queue 'idx' unless it was found already. Its offsets and value are
+ * prefetched, so that they are in cache by the time it is processed.
+ */
+static inline void visit(unsigned int idx)
+{
+	uint64_t bit = 1ULL << (idx % 64);
+
+	if (visited[idx / 64] & bit)
+		return;
+	visited[idx / 64] |= bit;
+
+	queue[tail++] = idx;
+	__builtin_prefetch(&graph->offsets[idx]);
+	__builtin_prefetch(&graph->values[idx]);
+}
+
+/*
+ * Sum up the values of the nodes reachable from 'root', breadth first.
+ * The queue is an explicit array, so that any graph depth works, and
+ * nodes are marked in a bitmap as they are queued, so each is queued
+ * once and the queue never holds more than all nodes.
+ */
+static void process_nodes(unsigned int root)
+{
+	queue = malloc(graph->num_nodes * sizeof(*queue));
+	visited = calloc(graph->num_nodes / 64 + 1, sizeof(*visited));
+	DIE(queue == NULL || visited == NULL, "malloc");
+
+	head = tail = 0;
+	visit(root);
+
+	while (head < tail) {
+		unsigned int idx = queue[head++];
+
+		sum += graph->values[idx];
+
+		if (graph->adj == NULL) {
+			unsigned int *neighbours = graph_neighbours(graph, idx);
+			unsigned int degree = graph_degree(graph, idx);
+
+			for (unsigned int i = 0; i < degree; i++) {
+				if (i + PREFETCH_DISTANCE < degree)
+					__builtin_prefetch(&visited[neighbours[i + PREFETCH_DISTANCE] / 64]);
+				visit(neighbours[i]);
+			}
+		} else {
+			/* Compressed lists only decode in order: no look-ahead. */
+			os_neighbour_iter_t it;
+			unsigned int v;
+
+			graph_iter_init(&it, graph, idx);
+			while (graph_iter_next(&it, v))
+				visit(v);
+		}
+	}
+
+	free(queue);
+	free(visited);
+}
+
+/* Root of the tree of 'idx', halving the path to it on the way. */
+static unsigned int find_root(unsigned int *label, unsigned int idx)
+{
+	while (label[idx] != idx) {
+		label[idx] = label[label[idx]];
+		idx = label[idx];
+	}
+
+	return idx;
+}
+
+/*
+ * Label all the connected components with union-find over the edges. The
+ * higher root is always hung under the lower one, so that, as for the
+ * parallel version, each component is labeled with its smallest node.
+ */
+static os_components_t *label_components(void)
+{
+	os_components_t *cc = create_components(graph->num_nodes);
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++)
+		cc->label[i] = i;
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++) {
+		os_neighbour_iter_t it;
+		unsigned int v;
+
+		graph_iter_init(&it, graph, i);
+		while (graph_iter_next(&it, v)) {
+			unsigned int a = find_root(cc->label, i);
+			unsigned int b = find_root(cc->label, v);
+
+			if (a < b)
+				cc->label[b] = a;
+			else if (b < a)
+				cc->label[a] = b;
+		}
+	}
+
+	/* Labels are lower than their nodes, so theirs are final by now. */
+	for (unsigned int i = 0; i < graph->num_nodes; i++) {
+		cc->label[i] = cc->label[cc->label[i]];
+		cc->size[i] = 0;
+		cc->sum[i] = 0;
+	}
+
+	for (unsigned int i = 0; i < graph->num_nodes; i++) {
+		cc->count += cc->label[i] == i;
+		cc->size[cc->label[i]]++;
+		cc->sum[cc->label[i]] += graph->values[i];
+	}
+
+	return cc;
+}
+
+/* Entry of the Dijkstra heap: a tentative distance of a node. */
+typedef struct {
+	unsigned long dist;
+	unsigned int node;
+} heap_entry_t;
+
+static void heap_push(heap_entry_t *heap, unsigned long *size, heap_entry_t e)
+{
+	unsigned long i = (*size)++;
+
+	while (i > 0 && heap[(i - 1) / 2].dist > e.dist) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = e;
+}
+
+static heap_entry_t heap_pop(heap_entry_t *heap, unsigned long *size)
+{
+	heap_entry_t top = heap[0];
+	heap_entry_t last = heap[--(*size)];
+	unsigned long i = 0;
+
+	while (2 * i + 1 < *size) {
+		unsigned long child = 2 * i + 1;
 
-static void process_node(unsigned int idx)
+		if (child + 1 < *size && heap[child + 1].dist < heap[child].dist)
+			child++;
+		if (heap[child].dist >= last.dist)
+			break;
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+
+	return top;
+}
+
+/*
+ * Distances of all nodes from 'root', by Dijkstra's algorithm on a binary
+ * heap: a node is pushed again whenever its distance drops, and its
+ * outdated entries are skipped once popped. Unreached nodes are at
+ * GRAPH_UNREACHABLE.
+ */
+static unsigned long *shortest_paths(unsigned int root)
+{
+	unsigned long size = 0, capacity = 64;
+	unsigned long *dist;
+	heap_entry_t *heap;
+
+	dist = malloc(graph->num_nodes * sizeof(*dist));
+	heap = malloc(capacity * sizeof(*heap));
+	DIE((dist == NULL && graph->num_nodes != 0) || heap == NULL, "malloc");
+	memset(dist, 0xff, graph->num_nodes * sizeof(*dist));
+
+	if (root < graph->num_nodes) {
+		dist[root] = 0;
+		heap_push(heap, &size, (heap_entry_t) { 0, root });
+	}
+
+	while (size > 0) {
+		heap_entry_t e = heap_pop(heap, &size);
+		unsigned long pos = graph->offsets[e.node];
+		os_neighbour_iter_t it;
+		unsigned int v;
+
+		if (e.dist > dist[e.node])
+			continue;
+
+		graph_iter_init(&it, graph, e.node);
+		while (graph_iter_next(&it, v)) {
+			unsigned long d = e.dist + graph_weight(graph, pos++);
+
+			if (d >= dist[v])
+				continue;
+			dist[v] = d;
+
+			if (size == capacity) {
+				capacity *= 2;
+				heap = realloc(heap, capacity * sizeof(*heap));
+				DIE(heap == NULL, "realloc");
+			}
+			heap_push(heap, &size, (heap_entry_t) { d, v });
+		}
+	}
+	free(heap);
+
+	return dist;
+}
+
+/*
+ * PageRank of all nodes, pulling, by plain sums in neighbour order: the
+ * reference for the parallel ranks. Runs up to 'max_iterations', or
+ * until no rank changes by more than GRAPH_PAGERANK_EPSILON times the mean.
+ */
+static double *page_rank(unsigned int max_iterations)
+{
+	unsigned int num_nodes = graph->num_nodes;
+	unsigned int num_dangling = 0;
+	double dangling_rank = 1.0 / num_nodes;
+	double *rank, *contrib, *next;
+
+	rank = malloc(num_nodes * sizeof(*rank));
+	contrib = malloc(num_nodes * sizeof(*contrib));
+	next = malloc(num_nodes * sizeof(*next));
+	DIE((rank == NULL || contrib == NULL || next == NULL) && num_nodes != 0, "malloc");
+
+	for (unsigned int v = 0; v < num_nodes; v++) {
+		unsigned int degree = graph_degree(graph, v);
+
+		rank[v] = 1.0 / num_nodes;
+		contrib[v] = degree != 0 ? rank[v] / degree : 0;
+		num_dangling += degree == 0;
+	}
+
+	for (unsigned int i = 0; i < max_iterations; i++) {
+		/* Nodes without edges, all ranked alike, share their rank out to all. */
+		double base = (1 - GRAPH_PAGERANK_DAMPING) / num_nodes +
+			GRAPH_PAGERANK_DAMPING * num_dangling * dangling_rank / num_nodes;
+		double change = 0, *swap;
+
+		for (unsigned int v = 0; v < num_nodes; v++) {
+			os_neighbour_iter_t it;
+			unsigned int u, degree = graph_degree(graph, v);
+			double sum = 0, r;
+
+			graph_iter_init(&it, graph, v);
+			while (graph_iter_next(&it, u))
+				sum += contrib[u];
+
+			r = base + GRAPH_PAGERANK_DAMPING * sum;
+			if (r - rank[v] > change)
+				change = r - rank[v];
+			else if (rank[v] - r > change)
+				change = rank[v] - r;
+			rank[v] = r;
+			next[v] = degree != 0 ? r / degree : 0;
+		}
+
+		swap = contrib;
+		contrib = next;
+		next = swap;
+		dangling_rank = base;
+		if (change < GRAPH_PAGERANK_EPSILON / num_nodes)
+			break;
+	}
+	free(contrib);
+	free(next);
+
+	return rank;
+}
+
+/* create_graph_from_data(), timed as the build phase. */
+static os_graph_t *timed_build(void *ctx, unsigned int num_nodes, unsigned int num_edges,
+		int *values, os_edge_t *edges, int weighted)
 {
-	os_node_t *node;
+	double start = timer_now();
+	os_graph_t *g;
+
+	(void) ctx;
+	g = create_graph_from_data(num_nodes, num_edges, values, edges, weighted);
+	times.build = timer_now() - start;
 
-	node = graph->nodes[idx];
-	sum += node->info;
-	graph->visited[idx] = DONE;
+	return g;
+}
 
-	for (unsigned int i = 0; i < node->num_neighbours; i++)
-		if (graph->visited[node->neighbours[i]] == NOT_VISITED)
-			process_node(node->neighbours[i]);
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "Usage: %s [-T] [-m sum|components|sssp|pagerank] [-i iterations] [-o none|degree|bfs|rcm] [-z] [-u updates_file] input_file\n",
+			argv0);
+	fprintf(stderr, "  -T  print the time of each phase to stderr\n");
+	fprintf(stderr, "  -m  sum of the component of node 0 (default), all components, the\n"
+			"      shortest path distances from node 0 (Dijkstra), or the PageRank of all nodes\n");
+	fprintf(stderr, "  -i  PageRank iterations at most (default: %d)\n", GRAPH_PAGERANK_ITERATIONS);
+	fprintf(stderr, "  -o  relabel the nodes for locality first, timed as part of the build\n");
+	fprintf(stderr, "  -z  compress the adjacency, then decode it while traversing\n");
+	fprintf(stderr, "  -u  then apply the batches of updates_file (see os_graph_update.h), printing\n"
+			"      the sum after each, or the components after the last one\n");
+	exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
 {
+	os_graph_order_t order = GRAPH_ORDER_NONE;
+	int compress = 0;
+	os_components_t *cc = NULL;
+	unsigned long *dist = NULL;
+	double *rank = NULL;
+	unsigned int iterations = GRAPH_PAGERANK_ITERATIONS;
+	run_mode_t mode = MODE_SUM;
+	int print_times = 0;
 	FILE *input_file;
+	FILE *updates_file = NULL;
+	double start;
+	char *end;
+	int opt;
 
-	if (argc != 2) {
-		fprintf(stderr, "Usage: %s input_file\n", argv[0]);
-		exit(EXIT_FAILURE);
+	while ((opt = getopt(argc, argv, "Tm:i:o:zu:")) != -1) {
+		switch (opt) {
+		case 'T':
+			print_times = 1;
+			break;
+		case 'm':
+			if (strcmp(optarg, "sum") == 0)
+				mode = MODE_SUM;
+			else if (strcmp(optarg, "components") == 0)
+				mode = MODE_COMPONENTS;
+			else if (strcmp(optarg, "sssp") == 0)
+				mode = MODE_SSSP;
+			else if (strcmp(optarg, "pagerank") == 0)
+				mode = MODE_PAGERANK;
+			else
+				usage(argv[0]);
+			break;
+		case 'i':
+			iterations = strtoul(optarg, &end, 10);
+			if (*optarg == '\0' || *optarg == '-' || *end != '\0' || iterations == 0)
+				usage(argv[0]);
+			break;
+		case 'o':
+			if (parse_graph_order(optarg, &order) < 0)
+				usage(argv[0]);
+			break;
+		case 'z':
+			compress = 1;
+			break;
+		case 'u':
+			updates_file = fopen(optarg, "r");
+			DIE(updates_file == NULL, "fopen");
+			break;
+		default:
+			usage(argv[0]);
+		}
 	}
 
-	input_file = fopen(argv[1], "r");
+	if (argc - optind != 1)
+		usage(argv[0]);
+	if (updates_file != NULL && mode != MODE_SUM && mode != MODE_COMPONENTS)
+		usage(argv[0]);
+
+	input_file = fopen(argv[optind], "r");
 	DIE(input_file == NULL, "fopen");
 
-	graph = create_graph_from_file(input_file);
+	start = timer_now();
+	graph = create_graph_from_file_with(input_file, timed_build, NULL);
+	if (graph == NULL) {
+		log_fatal("Can't load graph from %s", argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+	times.load = timer_now() - start - times.build;
+
+	if (order != GRAPH_ORDER_NONE) {
+		os_graph_t *reordered;
+
+		start = timer_now();
+		reordered = reorder_graph(graph, order);
+		destroy_graph(graph);
+		graph = reordered;
+		times.build += timer_now() - start;
+	}
 
-	process_node(0);
+	if (compress) {
+		start = timer_now();
+		compress_graph(graph);
+		times.build += timer_now() - start;
+	}
+
+	start = timer_now();
+	if (mode == MODE_COMPONENTS || updates_file != NULL)
+		cc = components_to_input(graph, label_components());
+	else if (mode == MODE_SSSP)
+		dist = shortest_paths(graph_node_from_input(graph, 0));
+	else if (mode == MODE_PAGERANK)
+		rank = page_rank(iterations);
+	else
+		process_nodes(graph_node_from_input(graph, 0));
+	times.traverse = timer_now() - start;
+
+	if (updates_file != NULL) {
+		os_dynamic_graph_t *dg = create_dynamic_graph(graph, cc);
+
+		if (replay_updates(dg, updates_file, mode == MODE_SUM) < 0)
+			exit(EXIT_FAILURE);
+		destroy_dynamic_graph(dg);
+		fclose(updates_file);
+	} else if (cc != NULL) {
+		print_components(cc);
+		destroy_components(cc);
+	} else if (dist != NULL) {
+		print_distances(graph, dist);
+		free(dist);
+	} else if (rank != NULL) {
+		print_ranks(graph, rank);
+		free(rank);
+	} else {
+		printf("%lld", sum);
+	}
 
-	printf("%d", sum);
+	if (print_times)
+		print_phase_times(&times);
 
 	return 0;
 }
@@ -0,0 +1,231 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+"""
+Benchmark for the "Parallel Graph" implementation.
+
+It runs `serial` and `parallel` (with -T, to get the load, build and
+traverse phase times) over the input files in in/ and over large graphs
+made by `graph_gen`, for a range of thread counts, a few times each. For every
+configuration it reports the median and percentiles of each phase, the
+traversal throughput in edges per second and the speedup over `serial`,
+as CSV or JSON, along with the flags the programs were built with
+($BUILD_FLAGS, set by `make bench`, which builds them optimized).
+"""
+
+import argparse
+import csv
+import json
+import os
+import statistics
+import struct
+import subprocess
+import sys
+
+src = os.environ.get("SRC_PATH", "../src")
+build_flags = os.environ.get("BUILD_FLAGS", "unknown")
+
+MODES = {
+    "flood": ([], ["-e", "flood"]),
+    "bfs": ([], ["-e", "bfs"]),
+    "components": (["-m", "components"], ["-m", "components"]),
+    "sssp": (["-m", "sssp"], ["-m", "sssp"]),
+    "pagerank": (["-m", "pagerank"], ["-m", "pagerank"]),
+}
+
+PHASES = ("load", "build", "traverse")
+
+
+def graph_size(path):
+    """Return the number of nodes and edges of a text or binary graph."""
+    with open(path, "rb") as f:
+        head = f.read(64)
+    if head.startswith(b"OSGRAPH\0"):
+        return struct.unpack_from("<QQ", head, 16)
+    nodes, edges = head.split()[:2]
+    return int(nodes), int(edges)
+
+
+def generated_inputs(specs, workdir, seed, weights):
+    """Generate (once) the graphs given as TYPE:PARAMS, in text and binary.
+
+    TYPE and PARAMS are those of graph_gen, e.g. rmat:18:16 or chain:1000000.
+    With 'weights', edges weigh up to that much.
+    """
+    inputs = []
+    gen = os.path.join(src, "graph_gen")
+    os.makedirs(workdir, exist_ok=True)
+    weight_args = ["-w", str(weights)] if weights else []
+    for spec in specs:
+        params = spec.split(":")
+        name = os.path.join(workdir, "_".join(params) + f"_{seed}")
+        if weights:
+            name += f"_w{weights}"
+        for ext, flags in ((".in", weight_args), (".bin", ["-b"] + weight_args)):
+            path = name + ext
+            if not os.path.exists(path):
+                print(f"generating {path}", file=sys.stderr)
+                subprocess.run([gen, "-s", str(seed)] + flags + params +
+                               [path + ".tmp"], check=True)
+                os.rename(path + ".tmp", path)
+            inputs.append(path)
+    return inputs
+
+
+def run(cmd):
+    """Run a program with -T; return its output and its phase times."""
+    proc = subprocess.run(cmd, capture_output=True, text=True, check=False)
+    if proc.returncode != 0:
+        raise RuntimeError(f"{' '.join(cmd)} failed: {proc.stderr.strip()}")
+    for line in proc.stderr.splitlines():
+        if line.startswith("phases:"):
+            fields = dict(f.split("=") for f in line.split()[1:])
+            return proc.stdout, {p: float(fields[p]) for p in PHASES}
+    raise RuntimeError(f"{' '.join(cmd)} printed no phase times")
+
+
+def percentile(values, pct):
+    """Percentile of a sample, interpolated between the closest ranks."""
+    values = sorted(values)
+    pos = (len(values) - 1) * pct / 100
+    low = int(pos)
+    high = min(low + 1, len(values) - 1)
+    return values[low] + (values[high] - values[low]) * (pos - low)
+
+
+def measure(cmd, repeat):
+    """Run a command 'repeat' times; return its output and phase samples."""
+    output = None
+    samples = {p: [] for p in PHASES}
+    for _ in range(repeat):
+        out, times = run(cmd)
+        if output is not None and out != output:
+            raise RuntimeError(f"{' '.join(cmd)}: output changed between runs")
+        output = out
+        for p in PHASES:
+            samples[p].append(times[p])
+        samples.setdefault("total", []).append(sum(times.values()))
+    return output, samples
+
+
+def summarize(row, samples, edges, serial_traverse):
+    """Add the statistics of a configuration to its result row."""
+    for phase, values in samples.items():
+        row[f"{phase}_median"] = round(statistics.median(values), 9)
+        row[f"{phase}_p10"] = round(percentile(values, 10), 9)
+        row[f"{phase}_p90"] = round(percentile(values, 90), 9)
+    traverse = row["traverse_median"]
+    row["edges_per_sec"] = edges / traverse if traverse > 0 else None
+    row["speedup"] = serial_traverse / traverse if traverse > 0 else None
+    return row
+
+
+def bench(inputs, modes, threads, repeat, extra_args):
+    """Benchmark every input, mode and thread count; return result rows."""
+    rows = []
+    for path in inputs:
+        nodes, edges = graph_size(path)
+        for mode in modes:
+            serial_args, parallel_args = MODES[mode]
+            base = {"input": os.path.basename(path), "nodes": nodes,
+                    "edges": edges, "mode": mode, "build_flags": build_flags}
+
+            cmd = [os.path.join(src, "serial"), "-T"] + serial_args + [path]
+            expected, samples = measure(cmd, repeat)
+            serial_traverse = statistics.median(samples["traverse"])
+            rows.append(summarize(dict(base, program="serial", threads=1,
+                                       correct=True),
+                                  samples, edges, serial_traverse))
+
+            for n in threads:
+                cmd = ([os.path.join(src, "parallel"), "-T", "-t", str(n)] +
+                       parallel_args + extra_args + [path])
+                output, samples = measure(cmd, repeat)
+                rows.append(summarize(dict(base, program="parallel", threads=n,
+                                           correct=output == expected),
+                                      samples, edges, serial_traverse))
+                print(f"{base['input']} {mode} t={n}: "
+                      f"{rows[-1]['traverse_median']:.6f}s "
+                      f"x{rows[-1]['speedup'] or 0:.2f}", file=sys.stderr)
+    return rows
+
+
+def write_rows(out, rows, fmt):
+    """Write the result rows as CSV or JSON."""
+    if fmt == "json":
+        json.dump(rows, out, indent=1)
+        out.write("\n")
+    else:
+        writer = csv.DictWriter(out, fieldnames=list(rows[0].keys()))
+        writer.writeheader()
+        writer.writerows(rows)
+
+
+def default_threads():
+    """Powers of two up to the number of CPUs, and that number itself."""
+    cpus = os.cpu_count() or 1
+    threads = [1]
+    while threads[-1] * 2 <= cpus:
+        threads.append(threads[-1] * 2)
+    if threads[-1] != cpus:
+        threads.append(cpus)
+    return threads
+
+
+def main():
+    """Parse the command line, run the benchmark and write the results."""
+    parser = argparse.ArgumentParser(description=__doc__.strip().split("\n")[0])
+    parser.add_argument("inputs", nargs="*",
+                        help="graph files (default: all of in/)")
+    parser.add_argument("--gen", action="append", default=None,
+                        metavar="TYPE:PARAMS",
+                        help="also run on a graph_gen graph, e.g. rmat:18:16, "
+                             "grid:1000:1000, chain:1000000 or star:1000000 "
+                             "(default: rmat:18:16; 'none' to skip)")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--weights", type=int, default=0, metavar="MAX",
+                        help="weigh the edges of generated graphs up to MAX, "
+                             "e.g. for sssp (default: unweighted)")
+    parser.add_argument("--workdir", default="bench_graphs",
+                        help="where generated graphs are kept")
+    parser.add_argument("--threads", default=None,
+                        help="comma separated thread counts "
+                             "(default: powers of two up to the CPU count)")
+    parser.add_argument("--modes", default="flood",
+                        help="comma separated, out of " + ", ".join(MODES))
+    parser.add_argument("--repeat", type=int, default=5)
+    parser.add_argument("--args", default="",
+                        help="extra arguments for parallel, e.g. '-s shared'")
+    parser.add_argument("--format", choices=("csv", "json"), default="csv")
+    parser.add_argument("--output", default="-", help="result file")
+    args = parser.parse_args()
+
+    inputs = args.inputs
+    if not inputs:
+        names = sorted(os.listdir("in"), key=lambda s: (len(s), s))
+        inputs = [os.path.join("in", name) for name in names]
+    gen = args.gen if args.gen is not None else ["rmat:18:16"]
+    if gen != ["none"]:
+        inputs += generated_inputs(gen, args.workdir, args.seed, args.weights)
+
+    threads = ([int(n) for n in args.threads.split(",")]
+               if args.threads else default_threads())
+    modes = args.modes.split(",")
+    for mode in modes:
+        if mode not in MODES:
+            parser.error(f"unknown mode {mode}")
+
+    rows = bench(inputs, modes, threads, args.repeat, args.args.split())
+
+    if args.output == "-":
+        write_rows(sys.stdout, rows, args.format)
+    else:
+        with open(args.output, "w", encoding="ascii", newline="") as out:
+            write_rows(out, rows, args.format)
+
+    if not all(row["correct"] for row in rows):
+        print("some parallel results differ from serial", file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
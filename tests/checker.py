@@ -5,15 +5,27 @@ Checker for the "Parallel Graph" assignment.
 
 It walks through the input test files in in/ and compares the serial case
 to the parallel case. It adds points and gives out the final result.
+
+It then checks, for no points, the modes other than the default one the
+same way, on the files in in/ and on those in extra/, also converted to
+the binary format. Each update file in extra/ is applied to the graph of
+the same name, and the output compared to that of the graph rebuilt with
+the updates in. Streaming is checked against `serial` on the text files.
 """
 
 import os
 import subprocess
+import sys
+import tempfile
 
 TOTAL = 0.0
 
 src = os.environ.get("SRC_PATH", "../src")
 
+# Thread counts to run `parallel` with for the other modes, a few times each.
+MODE_THREADS = (1, 4)
+MODE_RUNS = 3
+
 
 def check(testname):
     """Check a test file.
@@ -33,6 +45,115 @@ def check(testname):
     return True
 
 
+def run(program, args):
+    """Run one of the executables in src/ and return its output."""
+    return subprocess.run([os.path.join(src, program)] + args,
+                          stdout=subprocess.PIPE, check=False).stdout
+
+
+def check_mode(mode, tests):
+    """Check that `parallel -m mode` prints what `serial -m mode` does.
+
+    Return the first of `tests` on which it does not, None if there is none.
+    """
+    for testname in tests:
+        serial_out = run("serial", ["-m", mode, testname])
+        for threads in MODE_THREADS:
+            for _ in range(MODE_RUNS):
+                if run("parallel", ["-t", str(threads), "-m", mode,
+                                    testname]) != serial_out:
+                    return testname
+
+    return None
+
+
+def check_stream(tests):
+    """Check that `parallel -R`, in both its modes, prints what `serial` does.
+
+    The chunks are the smallest, so that numbers and lines get cut across
+    them. Return the first of the text `tests` on which it does not, None
+    if there is none.
+    """
+    for testname in tests:
+        for mode in ("sum", "components"):
+            serial_out = run("serial", ["-m", mode, testname])
+            for threads in MODE_THREADS:
+                for _ in range(MODE_RUNS):
+                    if run("parallel", ["-t", str(threads), "-m", mode,
+                                        "-R", "4", testname]) != serial_out:
+                        return f"{testname} ({mode})"
+
+    return None
+
+
+def read_updates(path):
+    """Return the batches of updates in `path`, each as a list of its lines."""
+    with open(path, encoding="ascii") as f:
+        lines = [line.split() for line in f if line.strip()]
+    batches = []
+    while lines:
+        count = int(lines.pop(0)[0])
+        batches.append(lines[:count])
+        del lines[:count]
+
+    return batches
+
+
+def rebuild(path, batches, out):
+    """Write to `out` the unweighted text graph in `path`, `batches` applied."""
+    with open(path, encoding="ascii") as f:
+        head, values, *edges = [line for line in f if line.strip()]
+    num_nodes = head.split()[0]
+    values = values.split()
+    edges = [line.strip() for line in edges]
+    for batch in batches:
+        for kind, node, arg in batch:
+            if kind == "e":
+                edges.append(f"{node} {arg}")
+            else:
+                values[int(node)] = arg
+    with open(out, "w", encoding="ascii") as f:
+        f.write(f"{num_nodes} {len(edges)}\n{' '.join(values)}\n")
+        f.write("".join(edge + "\n" for edge in edges))
+
+
+def check_updates(graph, updates, tmp):
+    """Check `serial -u` and `parallel -u` against `serial` on rebuilt graphs.
+
+    The sum after each batch, and the components after the last one, must
+    be those of `graph` rebuilt with the batches so far applied. Return
+    the first command that does not print them, None if there is none.
+    """
+    batches = read_updates(updates)
+    sums = []
+    for i in range(len(batches) + 1):
+        rebuilt = os.path.join(tmp, f"rebuilt{i}.in")
+        rebuild(graph, batches[:i], rebuilt)
+        sums += run("serial", [rebuilt]).split()
+    components = run("serial", ["-m", "components", rebuilt])
+
+    runs = [("serial", [])]
+    runs += [("parallel", ["-t", str(threads)])
+             for threads in MODE_THREADS for _ in range(MODE_RUNS)]
+    for program, args in runs:
+        if run(program, args + ["-u", updates, graph]).split() != sums:
+            return f"{program} -u {updates}"
+        if run(program, args + ["-m", "components", "-u", updates,
+                                graph]) != components:
+            return f"{program} -m components -u {updates}"
+
+    return None
+
+
+def report(name, failed):
+    """Print the result of a check for no points; return whether it passed."""
+    if failed is None:
+        print(name.ljust(33) + 23 * "." + " passed")
+        return True
+    print(name.ljust(33) + 23 * "." + f" failed on {failed}")
+    return False
+
+
 lst = os.listdir("in")
 lst.sort(key=lambda s: (len(s), s))
 for filename in lst:
@@ -43,5 +164,28 @@ for filename in lst:
     else:
         print(filename.ljust(33) + 23 * "." + " failed ...   0.0")
 
+print()
+with tempfile.TemporaryDirectory() as tmp:
+    tests = [os.path.join("in", filename) for filename in lst]
+    for filename in sorted(os.listdir("extra")):
+        if not filename.endswith(".in"):
+            continue
+        f = os.path.join("extra", filename)
+        b = os.path.join(tmp, filename[:-3] + ".bin")
+        run("graph_convert", [f, b])
+        tests += [f, b]
+
+    PASSED = report("components", check_mode("components", tests))
+    PASSED &= report("sssp", check_mode("sssp", tests))
+    PASSED &= report("pagerank", check_mode("pagerank", tests))
+    PASSED &= report("stream", check_stream([f for f in tests
+                                             if f.endswith(".in")]))
+
+    for filename in sorted(os.listdir("extra")):
+        if filename.endswith(".upd"):
+            f = os.path.join("extra", filename)
+            PASSED &= report(filename, check_updates(f[:-4] + ".in", f, tmp))
+
 TOTAL = int(TOTAL)
 print("\nTotal:" + 61 * " " + f" {TOTAL}/100")
+sys.exit(0 if PASSED else 1)